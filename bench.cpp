@@ -0,0 +1,1324 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <functional>
+#include <ctime>
+#include <thread>
+#include <sstream>
+#include <filesystem>
+#include <memory>
+#include "decision_tree.h"
+#include "random_forest.h"
+#include "image_processor.h"
+#include "centroid_scorer.h"
+#include "glcm.h"
+#include "feature_extractor.h"
+#include "ingest.h"
+#include "running_stats.h"
+#include "evaluation.h"
+#include "enhance.h"
+#include "process_stats.h"
+#ifdef TB_HAVE_COMPILED_TREE
+#include "compiled_tree.h"
+#endif
+
+using namespace std;
+
+// Every operator new in the process, for the allocation counts below
+static atomic<size_t> new_calls{0}, new_bytes{0};
+
+void* operator new(size_t n) {
+    new_calls++;
+    new_bytes += n;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 2)
+typedef cv::AccessFlag MatAccessFlag;
+#else
+typedef int MatAccessFlag;
+#endif
+
+// Mat buffers come from cv::fastMalloc, which operator new never sees.
+// main() makes this the default Mat allocator: it leaves the work to
+// OpenCV's standard allocator and tallies every buffer a Mat allocates
+// (bytes in flight and their peak too). Scratch OpenCV takes from
+// fastMalloc without a Mat is still not counted.
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    mutable atomic<size_t> calls{0}, bytes{0}, live{0}, peak{0};
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           MatAccessFlag flags, cv::UMatUsageFlags usage) const override {
+        cv::UMatData* u = standard()->allocate(dims, sizes, type, data, step, flags, usage);
+        if (!u) return u;
+        u->currAllocator = this;    // so the buffer is freed through deallocate()
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            calls++;
+            bytes += u->size;
+            size_t now = live += u->size;
+            size_t high = peak;
+            while (now > high && !peak.compare_exchange_weak(high, now)) {}
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, MatAccessFlag flags, cv::UMatUsageFlags usage) const override {
+        return standard()->allocate(u, flags, usage);
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        if (u && !(u->flags & cv::UMatData::USER_ALLOCATED)) live -= u->size;
+        standard()->deallocate(u);
+    }
+
+    // Start a new peak from the bytes in flight now
+    void reset_peak() { peak = live.load(); }
+
+private:
+    static cv::MatAllocator* standard() { return cv::Mat::getStdAllocator(); }
+};
+static CountingMatAllocator mat_allocator;
+
+// Allocation counters at one point in time; differences give a run's
+struct AllocCount {
+    size_t news, new_bytes, mats, mat_bytes;
+
+    static AllocCount now() {
+        return {new_calls, ::new_bytes, mat_allocator.calls, mat_allocator.bytes};
+    }
+};
+
+// ============ Results ============
+
+// One measurement as written by --json. Names are section/metric paths
+// (e.g. "tree/depth10/predict_flat"); correctness checks are recorded as
+// counts that must stay 0 (names ending in "mismatches" or
+// "allocations_over_hog_baseline"), and bench exits 1 if one is not.
+struct BenchResult {
+    string name;
+    double value;
+    string unit;
+};
+static vector<BenchResult> results;
+
+static void record(const string& name, double value, const string& unit) {
+    results.push_back({name, value, unit});
+}
+
+static bool endsWith(const string& s, const string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Prints every recorded check that is not 0 to stderr; returns how many
+static size_t reportFailedChecks() {
+    size_t failed = 0;
+    for (const BenchResult& r : results) {
+        bool check = endsWith(r.name, "mismatches") || endsWith(r.name, "allocations_over_hog_baseline");
+        if (check && r.value != 0) {
+            cerr << "FAILED: " << r.name << " = " << r.value << endl;
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static string jsonString(const string& s) {
+    string re = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { re += '\\'; re += (char)c; }
+        else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            re += buf;
+        }
+        else re += (char)c;
+    }
+    return re + "\"";
+}
+
+// {"schema": 1, "context": {...}, "results": [{"name", "value", "unit"}...]}
+// with the machine and build the numbers came from. Throws
+// std::runtime_error if the file cannot be written.
+static void writeJson(const string& path, const vector<string>& sections) {
+    ofstream out(path);
+    if (!out) throw runtime_error("Error: could not open " + path + " for writing");
+
+    char timestamp[32];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+#ifdef NDEBUG
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+#if defined(__clang__)
+    string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    string compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    string compiler = "msvc " + to_string(_MSC_VER);
+#else
+    string compiler = "unknown";
+#endif
+
+    out << "{\n  \"schema\": 1,\n  \"context\": {\n"
+        << "    \"timestamp\": " << jsonString(timestamp) << ",\n"
+        << "    \"compiler\": " << jsonString(compiler) << ",\n"
+        << "    \"build\": " << jsonString(build) << ",\n"
+        << "    \"hardware_threads\": " << thread::hardware_concurrency() << ",\n"
+        << "    \"sections\": [";
+    for (size_t i = 0; i < sections.size(); i++)
+        out << (i ? ", " : "") << jsonString(sections[i]);
+    out << "]\n  },\n  \"results\": [\n";
+    out << setprecision(numeric_limits<double>::max_digits10);
+    for (size_t i = 0; i < results.size(); i++) {
+        out << "    {\"name\": " << jsonString(results[i].name) << ", \"value\": ";
+        if (isfinite(results[i].value)) out << results[i].value;
+        else out << "null";  // JSON has no NaN or infinity
+        out << ", \"unit\": " << jsonString(results[i].unit) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    if (!out) throw runtime_error("Error: failed writing " + path);
+}
+
+// ============ Data ============
+
+// Synthetic two-class data: class 1 is shifted on a random subset of
+// features, so the tree has real splits to find at every depth.
+void makeData(size_t n, size_t f, unsigned seed,
+              vector<vector<double>>& X, vector<int>& y)
+{
+    mt19937 rng(seed);
+    normal_distribution<float> noise(0.0f, 1.0f);
+    X.assign(n, vector<double>(f));
+    y.assign(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        y[i] = rng() % 2;
+        for (size_t j = 0; j < f; j++) {
+            float v = noise(rng);
+            if (y[i] == 1 && j % 7 == 0) v += 0.5f;
+            X[i][j] = v;
+        }
+    }
+}
+
+// Average nanoseconds per predict() call over `rounds` passes of X
+double timePredict(DecisionTree& tree, const vector<vector<double>>& X,
+                   int rounds, long& checksum)
+{
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (const auto& x : X) checksum += tree.predict(x);
+    auto end = chrono::steady_clock::now();
+
+    double ns = chrono::duration<double, nano>(end - start).count();
+    return ns / (rounds * X.size());
+}
+
+// Average nanoseconds per sample for predict_batch() over a packed matrix
+double timeBatch(DecisionTree& tree, const vector<double>& packed,
+                 size_t rows, size_t cols, int threads, int rounds,
+                 vector<int>& out)
+{
+    out.resize(rows);
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        tree.predict_batch(packed.data(), rows, cols, out.data(), threads);
+    auto end = chrono::steady_clock::now();
+
+    double ns = chrono::duration<double, nano>(end - start).count();
+    return ns / (rounds * rows);
+}
+
+// Deterministic chest-X-ray-sized grayscale image: a bright rib-cage-like
+// band pattern over a dark background plus noise
+cv::Mat makeImage(int rows, int cols, unsigned seed) {
+    mt19937 rng(seed);
+    cv::Mat img(rows, cols, CV_8UC1);
+    for (int i = 0; i < rows; i++) {
+        uchar* p = img.ptr<uchar>(i);
+        for (int j = 0; j < cols; j++) {
+            double band = 0.5 + 0.5 * sin(i * 0.05) * cos(j * 0.01);
+            double lung = (j > cols / 5 && j < 4 * cols / 5) ? 0.6 : 1.0;
+            p[j] = (uchar)min(255.0, 255.0 * band * lung * 0.8 + rng() % 32);
+        }
+    }
+    return img;
+}
+
+// imageToVector + flatten (vector<vector<double>>) vs imageToRow (float
+// row): time, then the operator new calls, Mat buffers and bytes each
+// image allocates and the most Mat memory in flight at once, all counted
+void benchPreprocess() {
+    string path = "bench_image.png";
+    cv::imwrite(path, makeImage(1024, 1024, 7));
+
+    PreprocessParams params;
+    size_t cols = (size_t)params.image_size * params.image_size;
+    const int rounds = 50;
+
+    struct Run { double ms; AllocCount used; size_t mat_peak; };
+    auto measure = [&](auto&& preprocess) {
+        size_t live = mat_allocator.live;
+        mat_allocator.reset_peak();
+        AllocCount a0 = AllocCount::now();
+        auto t0 = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) preprocess(r);
+        auto t1 = chrono::steady_clock::now();
+        AllocCount a1 = AllocCount::now();
+        return Run{chrono::duration<double, milli>(t1 - t0).count() / rounds,
+                   {a1.news - a0.news, a1.new_bytes - a0.new_bytes,
+                    a1.mats - a0.mats, a1.mat_bytes - a0.mat_bytes},
+                   mat_allocator.peak - live};
+    };
+
+    double old_sum = 0;
+    Run old_run = measure([&](int r) {
+        vector<double> row = flatten(imageToVector(path, params));
+        old_sum += row[r % cols];
+    });
+    vector<feature_t> row(cols);
+    double new_sum = 0;
+    Run new_run = measure([&](int r) {
+        imageToRow(path, row.data(), params);
+        new_sum += row[r % cols];
+    });
+
+    for (auto named : {make_pair("imageToVector", &old_run), make_pair("imageToRow", &new_run)}) {
+        string name = string("preprocess/") + named.first;
+        const Run& run = *named.second;
+        record(name, run.ms, "ms/image");
+        record(name + "_new_calls", (double)run.used.news / rounds, "allocations/image");
+        record(name + "_mat_buffers", (double)run.used.mats / rounds, "allocations/image");
+        record(name + "_allocated_bytes", (double)(run.used.new_bytes + run.used.mat_bytes) / rounds,
+               "bytes/image");
+        record(name + "_mat_peak_bytes", (double)run.mat_peak, "bytes");
+    }
+    record("preprocess/peak_rss", (double)peakRssBytes(), "bytes");
+
+    auto line = [&](const char* label, const Run& run) {
+        cout << label << fixed << setprecision(3) << run.ms << " ms/image, " << setprecision(1)
+             << (double)run.used.news / rounds << " new + " << (double)run.used.mats / rounds
+             << " Mat buffers/image, " << (run.used.new_bytes + run.used.mat_bytes) / rounds / 1024
+             << " KB allocated/image, Mat peak " << run.mat_peak / 1024 << " KB";
+    };
+    line("preprocess imageToVector+flatten ", old_run);
+    cout << endl;
+    line("preprocess imageToRow            ", new_run);
+    cout << "  (max drift " << setprecision(2) << scientific << fabs(old_sum - new_sum) / rounds
+         << fixed << ")" << endl
+         << "peak RSS " << peakRssBytes() / (1024 * 1024) << " MB" << endl;
+
+    remove(path.c_str());
+}
+
+// The GLCM code extractFeatures used before GlcmEngine: one horizontal
+// offset, double counts through Mat::at
+void legacyGLCM(const cv::Mat& gray, double& contrast, double& energy,
+                double& homogeneity, double& entropy)
+{
+    cv::Mat quant = gray.clone();
+    quant.convertTo(quant, CV_8U, 1.0 / 8.0);
+
+    const int levels = 32;
+    cv::Mat glcm = cv::Mat::zeros(levels, levels, CV_64F);
+    for (int i = 0; i < quant.rows; i++)
+        for (int j = 0; j < quant.cols - 1; j++)
+            glcm.at<double>(quant.at<uchar>(i, j), quant.at<uchar>(i, j + 1))++;
+    glcm /= cv::sum(glcm)[0];
+
+    contrast = energy = homogeneity = entropy = 0.0;
+    for (int i = 0; i < levels; i++) {
+        for (int j = 0; j < levels; j++) {
+            double p = glcm.at<double>(i, j);
+            if (p <= 0) continue;
+            contrast += (i - j) * (i - j) * p;
+            energy += p * p;
+            homogeneity += p / (1.0 + abs(i - j));
+            entropy += -p * log2(p);
+        }
+    }
+}
+
+// Legacy single-offset GLCM vs GlcmEngine with one offset, the default
+// four angles at distance 1, and those angles at distances 1 and 2, in
+// pixels per second. The default engine's speed over legacy is recorded;
+// the richer features are meant to cost less than the one legacy offset.
+void benchGlcm() {
+    cv::Mat img = makeImage(1024, 1024, 7);
+    double pixels = (double)img.rows * img.cols;
+    const int rounds = 20;
+
+    double c, e, h, en, sink = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        legacyGLCM(img, c, e, h, en);
+        sink += c;
+    }
+    auto t1 = chrono::steady_clock::now();
+    double legacy_mps = pixels * rounds / chrono::duration<double>(t1 - t0).count() / 1e6;
+    record("glcm/legacy_1_offset", legacy_mps, "Mpixel/s");
+    cout << fixed << setprecision(1)
+         << "glcm legacy   1 offset    4 stats " << legacy_mps << " Mpixel/s" << endl;
+
+    vector<GlcmEngine> engines;
+    engines.emplace_back(vector<GlcmOffset>{{1, 0}});
+    engines.emplace_back();
+    engines.emplace_back(vector<int>{1, 2});
+    double default_mps = 0;
+    for (size_t i = 0; i < engines.size(); i++) {
+        GlcmEngine& engine = engines[i];
+        vector<double> out(engine.feature_count());
+        auto a = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            engine.compute(img, out.data());
+            sink += out[0];
+        }
+        auto b = chrono::steady_clock::now();
+        double mps = pixels * rounds / chrono::duration<double>(b - a).count() / 1e6;
+        record("glcm/engine_" + to_string(engine.offsets().size()) + "_offsets", mps, "Mpixel/s");
+        cout << "glcm engine " << setw(3) << engine.offsets().size() << " offsets "
+             << setw(3) << engine.feature_count() << " stats " << mps << " Mpixel/s  ("
+             << setprecision(2) << mps / legacy_mps << "x legacy)" << setprecision(1) << endl;
+        if (i == 1) default_mps = mps;
+    }
+    record("glcm/default_speedup_over_legacy", default_mps / legacy_mps, "x");
+    cout << "glcm default offsets run " << setprecision(2) << default_mps / legacy_mps
+         << "x as fast as legacy" << setprecision(1) << endl;
+    if (sink < 0) cout << sink << endl;
+}
+
+// extractFeatures as it was (HOG descriptor, Mats, GLCM engine and vectors
+// built per call, HOG values pushed one at a time) vs a reused
+// FeatureExtractor writing into one row: time, operator new calls and Mat
+// buffers per image. After warm-up the extractor may allocate only what
+// cv::HOGDescriptor::compute allocates inside, measured here on its own as
+// the baseline; more than that is recorded as a failure.
+void benchExtractor() {
+    cv::Mat img = makeImage(1024, 1024, 7);
+    const int rounds = 20;
+
+    FeatureExtractor extractor;
+    vector<double> row(extractor.size());
+    extractor.extract(img, row.data());  // warm-up: buffers reach their size
+
+    auto elapsed = [](chrono::steady_clock::time_point a, chrono::steady_clock::time_point b) {
+        return chrono::duration<double, milli>(b - a).count() / rounds;
+    };
+
+    vector<double> old;
+    AllocCount a0 = AllocCount::now();
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        vector<double> re;
+        GlcmEngine glcm;
+        vector<double> glcm_features = glcm.compute(img);
+        cv::HOGDescriptor hog(cv::Size(64, 128), cv::Size(16, 16), cv::Size(8, 8),
+                              cv::Size(8, 8), 9);
+        cv::Mat resized;
+        cv::resize(img, resized, cv::Size(64, 128));
+        vector<float> hog_features;
+        hog.compute(resized, hog_features);
+        for (float v : hog_features) re.push_back(v);
+        re.insert(re.end(), glcm_features.begin(), glcm_features.end());
+        old.swap(re);
+    }
+    auto t1 = chrono::steady_clock::now();
+    AllocCount a1 = AllocCount::now();
+    for (int r = 0; r < rounds; r++) extractor.extract(img, row.data());
+    auto t2 = chrono::steady_clock::now();
+    AllocCount a2 = AllocCount::now();
+
+    // HOG alone on a window, with its descriptor buffer already sized
+    cv::HOGDescriptor hog(cv::Size(64, 128), cv::Size(16, 16), cv::Size(8, 8),
+                          cv::Size(8, 8), 9);
+    cv::Mat window;
+    cv::resize(img, window, cv::Size(64, 128));
+    vector<float> descriptors;
+    hog.compute(window, descriptors);
+    AllocCount a3 = AllocCount::now();
+    for (int r = 0; r < rounds; r++) hog.compute(window, descriptors);
+    AllocCount a4 = AllocCount::now();
+
+    size_t extractor_news = a2.news - a1.news, extractor_mats = a2.mats - a1.mats;
+    size_t hog_news = a4.news - a3.news, hog_mats = a4.mats - a3.mats;
+    bool over_baseline = extractor_news > hog_news || extractor_mats > hog_mats;
+
+    record("extract/per_call", elapsed(t0, t1), "ms/image");
+    record("extract/per_call_allocations", (double)(a1.news - a0.news) / rounds, "allocations/image");
+    record("extract/per_call_mat_buffers", (double)(a1.mats - a0.mats) / rounds, "allocations/image");
+    record("extract/extractor", elapsed(t1, t2), "ms/image");
+    record("extract/extractor_allocations", (double)extractor_news / rounds, "allocations/image");
+    record("extract/extractor_mat_buffers", (double)extractor_mats / rounds, "allocations/image");
+    record("extract/hog_baseline_allocations", (double)hog_news / rounds, "allocations/image");
+    record("extract/hog_baseline_mat_buffers", (double)hog_mats / rounds, "allocations/image");
+    record("extract/allocations_over_hog_baseline", over_baseline ? 1 : 0, "count");
+    record("extract/mismatches", old == row ? 0 : 1, "count");
+
+    cout << fixed << setprecision(3)
+         << "extract per call          " << elapsed(t0, t1) << " ms/image, " << setprecision(1)
+         << (double)(a1.news - a0.news) / rounds << " new + "
+         << (double)(a1.mats - a0.mats) / rounds << " Mat buffers/image" << endl
+         << "extract FeatureExtractor  " << setprecision(3) << elapsed(t1, t2) << " ms/image, "
+         << setprecision(1) << (double)extractor_news / rounds << " new + "
+         << (double)extractor_mats / rounds << " Mat buffers/image  (HOG alone "
+         << (double)hog_news / rounds << " + " << (double)hog_mats / rounds << ")"
+         << (over_baseline ? "  (ABOVE HOG BASELINE)" : "")
+         << (old == row ? "" : "  (MISMATCH)") << endl;
+}
+
+// Old scoring (normalize a copy, then dot against both centroids) vs the
+// folded single-pass CentroidScorer
+void benchScoring() {
+    const size_t n = 2304, images = 2000;
+    mt19937 rng(3);
+    normal_distribution<double> noise(0.0, 1.0);
+
+    vector<double> normal(n), tb(n), means(n), stdevs(n);
+    for (size_t j = 0; j < n; j++) {
+        normal[j] = noise(rng) * 0.1;
+        tb[j] = noise(rng) * 0.1;
+        means[j] = noise(rng) * 0.05;
+        stdevs[j] = 0.5 + fabs(noise(rng));
+    }
+    FeatureMatrix X;
+    X.resize(images, n);
+    for (feature_t& v : X.data) v = (feature_t)noise(rng);
+
+    const int rounds = 20;
+    vector<double> old_scores(images), new_scores(images);
+    vector<double> z(n);
+
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < images; i++) {
+            const feature_t* x = X.row(i);
+            for (size_t j = 0; j < n; j++)
+                z[j] = stdevs[j] > 1e-10 ? (x[j] - means[j]) / stdevs[j] : 0.0;
+            double score_norm = 0, score_pos = 0;
+            for (size_t j = 0; j < n; j++) score_norm += z[j] * normal[j];
+            for (size_t j = 0; j < n; j++) score_pos += z[j] * tb[j];
+            old_scores[i] = score_pos - score_norm;
+        }
+    }
+    auto t1 = chrono::steady_clock::now();
+    CentroidScorer scorer(normal.data(), tb.data(), means.data(), stdevs.data(), n);
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < images; i++) new_scores[i] = scorer.score(X.row(i));
+    auto t2 = chrono::steady_clock::now();
+
+    double max_diff = 0;
+    for (size_t i = 0; i < images; i++)
+        max_diff = max(max_diff, fabs(old_scores[i] - new_scores[i]));
+    record("scoring/normalize_2_dots", chrono::duration<double, nano>(t1 - t0).count() / (rounds * images), "ns/image");
+    record(string("scoring/folded_") + scorer.kernel(),
+           chrono::duration<double, nano>(t2 - t1).count() / (rounds * images), "ns/image");
+    record("scoring/max_abs_diff", max_diff, "score");
+
+    cout << fixed << setprecision(1)
+         << "scoring normalize+2 dots " << chrono::duration<double, nano>(t1 - t0).count() / (rounds * images)
+         << " ns/image  folded (" << scorer.kernel() << ") "
+         << chrono::duration<double, nano>(t2 - t1).count() / (rounds * images)
+         << " ns/image  max |diff| " << scientific << setprecision(2) << max_diff << fixed << endl;
+}
+
+static string readBytes(const string& path) {
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+// Training wall time at 1..16 threads on data shaped like the radiograph
+// set (4200 images, 48x48 features); every tree must match the 1-thread one
+void benchTraining() {
+    vector<vector<double>> X;
+    vector<int> y;
+    makeData(4200, 2304, 5, X, y);
+
+    double base_ms = 0;
+    string base_file;
+    for (int threads : {1, 2, 4, 8, 16}) {
+        DecisionTree tree(8, 2);
+        auto t0 = chrono::steady_clock::now();
+        tree.train(X, y, threads);
+        auto t1 = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(t1 - t0).count();
+
+        tree.save("bench_train.bin");
+        string file = readBytes("bench_train.bin");
+        if (threads == 1) {
+            base_ms = ms;
+            base_file = file;
+        }
+
+        string name = "training/threads" + to_string(threads);
+        record(name, ms, "ms");
+        record(name + "_different_trees", file == base_file ? 0 : 1, "count");
+        cout << "train " << setw(2) << threads << " threads " << fixed << setprecision(1)
+             << ms << " ms  speedup " << setprecision(2) << base_ms / ms << "x"
+             << (file == base_file ? "" : "  (DIFFERENT TREE)") << endl;
+    }
+    remove("bench_train.bin");
+}
+
+// Single depth-5 tree vs a random forest: held-out accuracy and batch
+// inference throughput
+void benchForest(const vector<vector<double>>& X, const vector<int>& y,
+                 const vector<vector<double>>& X_test, const vector<int>& y_test,
+                 const vector<double>& packed)
+{
+    size_t rows = X_test.size(), cols = X_test[0].size();
+    vector<int> out(rows);
+    auto accuracy = [&] {
+        size_t correct = 0;
+        for (size_t i = 0; i < rows; i++) correct += out[i] == y_test[i];
+        return 100.0 * correct / rows;
+    };
+    auto imagesPerSecond = [&](auto&& predict) {
+        const int rounds = 5;
+        auto t0 = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) predict();
+        double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        return rounds * rows / s;
+    };
+
+    DecisionTree tree(5, 2);
+    tree.train(X, y);
+    tree.compile();
+    double tree_ips = imagesPerSecond([&] { tree.predict_batch(packed.data(), rows, cols, out.data()); });
+    double tree_acc = accuracy();
+
+    RandomForest forest(100, 12, 2);
+    auto t0 = chrono::steady_clock::now();
+    forest.train(X, y);
+    double train_s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    double forest_ips = imagesPerSecond([&] { forest.predict_batch(packed.data(), rows, cols, out.data()); });
+    double forest_acc = accuracy();
+    double threaded_ips = imagesPerSecond([&] { forest.predict_batch(packed.data(), rows, cols, out.data(), 0); });
+    record("forest/tree_depth5_accuracy", tree_acc, "%");
+    record("forest/tree_depth5_predict", tree_ips, "images/s");
+    record("forest/train", train_s * 1000, "ms");
+    record("forest/accuracy", forest_acc, "%");
+    record("forest/oob_error", forest.oob_error() * 100, "%");
+    record("forest/predict", forest_ips, "images/s");
+    record("forest/predict_threaded", threaded_ips, "images/s");
+
+    cout << fixed << setprecision(1)
+         << "tree   depth 5         accuracy " << tree_acc << "%  " << setprecision(0)
+         << tree_ips << " images/s" << endl
+         << setprecision(1)
+         << "forest " << forest.size() << " trees depth 12 accuracy " << forest_acc << "%  "
+         << setprecision(0) << forest_ips << " images/s, " << threaded_ips << " images/s threaded  ("
+         << setprecision(1) << train_s << " s to train, OOB error "
+         << setprecision(2) << forest.oob_error() * 100 << "%, " << forest.node_count() << " nodes)" << endl;
+}
+
+// Double features vs uint8 bin indices: training time, held-out accuracy,
+// batch inference time and matrix size at the same depth
+void benchQuantized(const vector<vector<double>>& X, const vector<int>& y,
+                    const vector<vector<double>>& X_test, const vector<int>& y_test,
+                    const vector<double>& packed)
+{
+    size_t rows = X_test.size(), cols = X_test[0].size();
+
+    auto t0 = chrono::steady_clock::now();
+    FeatureBinner bins;
+    bins.fit(X);
+    BinnedMatrix B, B_test;
+    bins.transform(X, B);
+    bins.transform(X_test, B_test);
+    auto t1 = chrono::steady_clock::now();
+    double bin_ms = chrono::duration<double, milli>(t1 - t0).count();
+
+    for (int depth : {5, 10}) {
+        DecisionTree raw(depth, 2), binned(depth, 2);
+        auto a0 = chrono::steady_clock::now();
+        raw.train(X, y);
+        auto a1 = chrono::steady_clock::now();
+        binned.train_binned(B, y, bins);
+        auto a2 = chrono::steady_clock::now();
+        raw.compile();
+
+        vector<int> raw_out, bin_out(rows), check(rows);
+        double raw_ns = timeBatch(raw, packed, rows, cols, 1, 20, raw_out);
+        auto b0 = chrono::steady_clock::now();
+        for (int r = 0; r < 20; r++)
+            binned.predict_batch(B_test.data.data(), rows, cols, bin_out.data());
+        auto b1 = chrono::steady_clock::now();
+        double bin_ns = chrono::duration<double, nano>(b1 - b0).count() / (20 * rows);
+
+        // The binned tree's raw thresholds must agree with its bin splits
+        binned.predict_batch(packed.data(), rows, cols, check.data());
+
+        size_t raw_ok = 0, bin_ok = 0;
+        for (size_t i = 0; i < rows; i++) {
+            raw_ok += raw_out[i] == y_test[i];
+            bin_ok += bin_out[i] == y_test[i];
+        }
+        string name = "quantized/depth" + to_string(depth);
+        record(name + "/train_double", chrono::duration<double, milli>(a1 - a0).count(), "ms");
+        record(name + "/train_bins", chrono::duration<double, milli>(a2 - a1).count(), "ms");
+        record(name + "/predict_double", raw_ns, "ns/sample");
+        record(name + "/predict_bins", bin_ns, "ns/sample");
+        record(name + "/raw_bin_mismatches", check == bin_out ? 0 : 1, "count");
+
+        cout << "depth " << setw(2) << depth << fixed
+             << "  double: train " << setprecision(1) << chrono::duration<double, milli>(a1 - a0).count()
+             << " ms, acc " << setprecision(2) << 100.0 * raw_ok / rows << "%, " << raw_ns << " ns/sample"
+             << "  uint8 bins: train " << setprecision(1) << chrono::duration<double, milli>(a2 - a1).count()
+             << " ms, acc " << setprecision(2) << 100.0 * bin_ok / rows << "%, " << bin_ns << " ns/sample"
+             << (check == bin_out ? "" : "  (RAW/BIN MISMATCH)") << endl;
+    }
+    record("quantized/fit_transform", bin_ms, "ms");
+    cout << "matrix " << rows * cols * sizeof(double) / 1024 << " KB as double, "
+         << B_test.data.size() / 1024 << " KB as bins (fit+transform " << setprecision(1)
+         << bin_ms << " ms)" << endl;
+}
+
+// The exhaustive split search DecisionTree::build used before the
+// sort-once sweep: every row's value of every feature is tried as the
+// threshold (x < t goes left), and only a strictly lower Gini replaces the
+// best, so ties go to the lowest feature, then the earliest row.
+struct ReferenceNode {
+    bool is_leaf = false;
+    int predicted_class = -1;
+    int feature_index = -1;
+    double threshold = 0.0;
+    unique_ptr<ReferenceNode> left, right;
+};
+
+static double referenceGini(const vector<int>& labels) {
+    int count0 = 0, count1 = 0;
+    for (int y : labels) (y == 0) ? count0++ : count1++;
+    double p0 = (double)count0 / labels.size();
+    double p1 = (double)count1 / labels.size();
+    return 1.0 - (p0*p0 + p1*p1);
+}
+
+static int referenceMostCommon(const vector<int>& labels) {
+    int count1 = (int)count(labels.begin(), labels.end(), 1);
+    return (count1 > (int)labels.size() - count1) ? 1 : 0;
+}
+
+unique_ptr<ReferenceNode> referenceBuild(const vector<vector<double>>& X, const vector<int>& y,
+                                         int depth, int max_depth, int min_samples)
+{
+    auto node = make_unique<ReferenceNode>();
+    if (depth >= max_depth || y.size() <= (size_t)min_samples || referenceGini(y) == 0.0) {
+        node->is_leaf = true;
+        node->predicted_class = referenceMostCommon(y);
+        return node;
+    }
+
+    int best_feature = -1;
+    double best_threshold = 0.0;
+    double best_gini = numeric_limits<double>::infinity();
+    for (size_t f = 0; f < X[0].size(); f++) {
+        for (size_t i = 0; i < X.size(); i++) {
+            double t = X[i][f];
+            vector<int> left_y, right_y;
+            for (size_t j = 0; j < X.size(); j++)
+                (X[j][f] < t ? left_y : right_y).push_back(y[j]);
+            if (left_y.empty() || right_y.empty()) continue;
+
+            double g = (left_y.size() * referenceGini(left_y) +
+                        right_y.size() * referenceGini(right_y))
+                        / y.size();
+            if (g < best_gini) {
+                best_gini = g;
+                best_feature = (int)f;
+                best_threshold = t;
+            }
+        }
+    }
+    if (best_feature == -1) {
+        node->is_leaf = true;
+        node->predicted_class = referenceMostCommon(y);
+        return node;
+    }
+
+    node->feature_index = best_feature;
+    node->threshold = best_threshold;
+    vector<vector<double>> left_X, right_X;
+    vector<int> left_y, right_y;
+    for (size_t i = 0; i < X.size(); i++) {
+        bool left = X[i][best_feature] < best_threshold;
+        (left ? left_X : right_X).push_back(X[i]);
+        (left ? left_y : right_y).push_back(y[i]);
+    }
+    node->left = referenceBuild(left_X, left_y, depth + 1, max_depth, min_samples);
+    node->right = referenceBuild(right_X, right_y, depth + 1, max_depth, min_samples);
+    return node;
+}
+
+// Nodes of `expected` that `actual` does not reproduce: a different leaf
+// class, split feature or threshold, or a leaf where there should be a
+// split (or the reverse), which counts that whole reference subtree
+static size_t countNodeMismatches(const ReferenceNode* expected, const Node* actual) {
+    if (!actual || expected->is_leaf != actual->is_leaf) {
+        if (expected->is_leaf) return 1;
+        return 1 + countNodeMismatches(expected->left.get(), nullptr) +
+                   countNodeMismatches(expected->right.get(), nullptr);
+    }
+    if (expected->is_leaf) return expected->predicted_class != actual->predicted_class;
+    if (expected->feature_index != actual->feature_index || expected->threshold != actual->threshold) {
+        return 1 + countNodeMismatches(expected->left.get(), nullptr) +
+                   countNodeMismatches(expected->right.get(), nullptr);
+    }
+    return countNodeMismatches(expected->left.get(), actual->left) +
+           countNodeMismatches(expected->right.get(), actual->right);
+}
+
+// Sort-once split search against the exhaustive reference on small
+// fixtures built to tie: few distinct values (duplicates everywhere),
+// duplicated and constant columns (equal Gini across features) and labels
+// with no signal (many equal-Gini thresholds). Trees are built at 1 and 4
+// threads and must match the reference node for node.
+void benchSplitSearch() {
+    struct Fixture { const char* name; size_t rows, cols; int levels; };
+    const Fixture fixtures[] = {
+        {"binary", 120, 4, 2},
+        {"few_values", 300, 6, 5},
+        {"duplicate_columns", 300, 6, 8},
+        {"noise_labels", 400, 5, 3},
+        {"wide_values", 200, 8, 1000},
+    };
+
+    size_t total = 0;
+    for (const Fixture& fx : fixtures) {
+        mt19937 rng(11);
+        vector<vector<double>> X(fx.rows, vector<double>(fx.cols));
+        vector<int> y(fx.rows);
+        string name = fx.name;
+        for (size_t i = 0; i < fx.rows; i++) {
+            for (size_t j = 0; j < fx.cols; j++)
+                X[i][j] = (double)(rng() % fx.levels) * 0.25 - 0.5;
+            if (name == "duplicate_columns") {
+                X[i][1] = X[i][0];      // feature ties
+                X[i][3] = X[i][2];
+                X[i][5] = 1.0;          // never splits
+            }
+            // Signal on features 0 and 2, except for noise_labels
+            bool signal = X[i][0] + X[i][2] > 0.0;
+            y[i] = (name == "noise_labels") ? (int)(rng() % 2)
+                                            : (int)((rng() % 4 == 0) ? !signal : signal);
+        }
+
+        for (int depth : {3, 8}) {
+            unique_ptr<ReferenceNode> expected = referenceBuild(X, y, 0, depth, 2);
+            for (int threads : {1, 4}) {
+                DecisionTree tree(depth, 2);
+                tree.train(X, y, threads);
+                size_t mismatches = countNodeMismatches(expected.get(), tree.root);
+                total += mismatches;
+                string metric = string("split_search/") + fx.name + "/depth" + to_string(depth) +
+                                "_threads" + to_string(threads) + "_mismatches";
+                record(metric, (double)mismatches, "count");
+                if (mismatches) {
+                    cout << "split search " << fx.name << " depth " << depth << " threads " << threads
+                         << ": " << mismatches << " nodes differ from the exhaustive search  (MISMATCH)" << endl;
+                }
+            }
+        }
+    }
+    record("split_search/mismatches", (double)total, "count");
+    cout << "split search: " << size(fixtures) << " fixtures against the exhaustive search, "
+         << total << " mismatched nodes" << (total ? "  (MISMATCH)" : "") << endl;
+}
+
+// The pointer tree's label for x. `narrowed` is set if some node on the
+// path would send x the other way with its threshold rounded to float, as
+// the compiled form stores it; `as_float` gets the label of that walk.
+static int walkPointerTree(const Node* node, const double* x, bool& narrowed, int& as_float) {
+    const Node* rounded = node;
+    narrowed = false;
+    while (!node->is_leaf) {
+        bool left = x[node->feature_index] < node->threshold;
+        narrowed = narrowed || left != (x[node->feature_index] < (double)(float)node->threshold);
+        node = left ? node->left : node->right;
+    }
+    while (!rounded->is_leaf) {
+        bool left = x[rounded->feature_index] < (double)(float)rounded->threshold;
+        rounded = left ? rounded->left : rounded->right;
+    }
+    as_float = rounded->predicted_class;
+    return node->predicted_class;
+}
+
+// Row-by-row agreement of a compiled tree's forms on X: predict() (flat)
+// and predict_batch at 1 thread and all cores must equal the pointer tree
+// walked with float thresholds, and the pointer tree itself may only
+// differ on rows whose path crosses a threshold narrowed to float (counted
+// in `narrowed`). Returns the rows breaking either rule.
+static size_t treeFormMismatches(DecisionTree& tree, const vector<vector<double>>& X,
+                                 size_t& narrowed)
+{
+    size_t rows = X.size(), cols = X[0].size();
+    vector<double> packed(rows * cols);
+    for (size_t r = 0; r < rows; r++) copy(X[r].begin(), X[r].end(), packed.begin() + r * cols);
+    vector<int> batch1(rows), batchN(rows);
+    tree.predict_batch(packed.data(), rows, cols, batch1.data(), 1);
+    tree.predict_batch(packed.data(), rows, cols, batchN.data(), 0);
+
+    size_t mismatches = 0;
+    narrowed = 0;
+    for (size_t i = 0; i < rows; i++) {
+        bool crossed;
+        int as_float;
+        int pointer = walkPointerTree(tree.root, X[i].data(), crossed, as_float);
+        int flat = tree.predict(X[i]);
+        narrowed += crossed;
+        if (flat != as_float || batch1[i] != flat || batchN[i] != flat ||
+            (pointer != flat && !crossed))
+            mismatches++;
+    }
+    return mismatches;
+}
+
+// DecisionTree::build and predict at several depths: training time, then
+// per-sample inference through the pointer tree, the compiled flat layout
+// and predict_batch (1 thread and all cores), checked row by row. The
+// synthetic features are float values, so the float thresholds change no
+// route; a second, double-valued set (thresholds are training values, so
+// rows land exactly on them) checks that only narrowed paths differ.
+void benchTree(const vector<vector<double>>& X, const vector<int>& y,
+               const vector<vector<double>>& X_test, const vector<double>& packed)
+{
+    size_t cols = X_test[0].size();
+    for (int depth : {5, 10, 16}) {
+        DecisionTree tree(depth, 2);
+        auto t0 = chrono::steady_clock::now();
+        tree.train(X, y);
+        auto t1 = chrono::steady_clock::now();
+
+        long pointer_sum = 0, flat_sum = 0;
+        double pointer_ns = timePredict(tree, X_test, 20, pointer_sum);
+        tree.compile();
+        double flat_ns = timePredict(tree, X_test, 20, flat_sum);
+
+        vector<int> batch1, batchN;
+        double batch_ns = timeBatch(tree, packed, X_test.size(), cols, 1, 20, batch1);
+        double threaded_ns = timeBatch(tree, packed, X_test.size(), cols, 0, 20, batchN);
+        size_t narrowed;
+        size_t mismatches = treeFormMismatches(tree, X_test, narrowed) + narrowed;
+
+        double train_ms = chrono::duration<double, milli>(t1 - t0).count();
+        string name = "tree/depth" + to_string(depth);
+        record(name + "/train", train_ms, "ms");
+        record(name + "/predict_pointer", pointer_ns, "ns/sample");
+        record(name + "/predict_flat", flat_ns, "ns/sample");
+        record(name + "/predict_batch", batch_ns, "ns/sample");
+        record(name + "/predict_batch_threaded", threaded_ns, "ns/sample");
+        record(name + "/mismatches", (double)mismatches, "count");
+
+        cout << "depth " << setw(2) << depth
+             << "  train " << fixed << setprecision(1) << train_ms << " ms"
+             << "  pointer " << setprecision(2) << pointer_ns << " ns/sample"
+             << "  flat " << flat_ns << " ns/sample"
+             << "  batch " << batch_ns << " ns/sample"
+             << "  batch/threads " << threaded_ns << " ns/sample"
+             << (mismatches ? "  (" + to_string(mismatches) + " MISMATCHES)" : "") << endl;
+    }
+
+    // Double-valued features: float values plus an offset below float
+    // precision, tested on the training rows and fresh ones
+    vector<vector<double>> Xd, Xd_fresh;
+    vector<int> yd, unused;
+    makeData(2000, 32, 9, Xd, yd);
+    makeData(2000, 32, 10, Xd_fresh, unused);
+    mt19937 rng(9);
+    uniform_real_distribution<double> offset(-1e-6, 1e-6);
+    for (auto* set : {&Xd, &Xd_fresh})
+        for (auto& row : *set)
+            for (double& v : row) v += offset(rng);
+    vector<vector<double>> rows = Xd;
+    rows.insert(rows.end(), Xd_fresh.begin(), Xd_fresh.end());
+
+    DecisionTree tree(10, 2);
+    tree.train(Xd, yd);
+    tree.compile();
+    size_t narrowed;
+    size_t mismatches = treeFormMismatches(tree, rows, narrowed);
+    record("tree/double_inputs/narrowed_rows", (double)narrowed, "count");
+    record("tree/double_inputs/mismatches", (double)mismatches, "count");
+    cout << "double inputs: " << narrowed << "/" << rows.size()
+         << " rows cross a float-narrowed threshold, " << mismatches << " mismatches"
+         << (mismatches ? "  (MISMATCH)" : "") << endl;
+}
+
+// Model file round trips: cold-start time and threshold exactness
+void benchModelFiles(const vector<vector<double>>& X, const vector<int>& y,
+                     const vector<vector<double>>& X_test)
+{
+    DecisionTree tree(10, 2);
+    tree.train(X, y);
+    tree.compile();
+
+    auto t0 = chrono::steady_clock::now();
+    tree.export_text("bench_tree.txt");
+    auto t1 = chrono::steady_clock::now();
+    tree.save("bench_tree.bin");
+    auto t2 = chrono::steady_clock::now();
+
+    DecisionTree from_text, from_binary;
+    auto t3 = chrono::steady_clock::now();
+    from_text.import_text("bench_tree.txt");
+    auto t4 = chrono::steady_clock::now();
+    from_binary.load("bench_tree.bin");
+    auto t5 = chrono::steady_clock::now();
+
+    // Text must reproduce every double threshold, binary every compiled one
+    vector<Node*> a = {tree.root}, b = {from_text.root};
+    size_t text_nodes = 0, text_exact = 0;
+    while (!a.empty() && !b.empty()) {
+        Node* p = a.back(); a.pop_back();
+        Node* q = b.back(); b.pop_back();
+        if (!p || !q) continue;
+        text_nodes++;
+        if (memcmp(&p->threshold, &q->threshold, sizeof(double)) == 0) text_exact++;
+        a.push_back(p->left); a.push_back(p->right);
+        b.push_back(q->left); b.push_back(q->right);
+    }
+    from_text.compile();
+    size_t binary_mismatch = 0;
+    for (const auto& x : X_test)
+        binary_mismatch += (from_binary.predict(x) != tree.predict(x)) +
+                           (from_text.predict(x) != tree.predict(x));
+
+    auto ms = [](chrono::steady_clock::time_point a, chrono::steady_clock::time_point b) {
+        return chrono::duration<double, milli>(b - a).count();
+    };
+    record("model_files/text_save", ms(t0, t1), "ms");
+    record("model_files/text_load", ms(t3, t4), "ms");
+    record("model_files/binary_save", ms(t1, t2), "ms");
+    record("model_files/binary_load", ms(t4, t5), "ms");
+    record("model_files/text_inexact_thresholds", (double)(text_nodes - text_exact), "count");
+    record("model_files/prediction_mismatches", (double)binary_mismatch, "count");
+
+    cout << fixed << setprecision(3)
+         << "text   save " << ms(t0, t1) << " ms  load " << ms(t3, t4) << " ms  "
+         << text_exact << "/" << text_nodes << " thresholds bit-exact" << endl
+         << "binary save " << ms(t1, t2) << " ms  load " << ms(t4, t5) << " ms  "
+         << binary_mismatch << " prediction mismatches" << endl;
+
+    remove("bench_tree.txt");
+    remove("bench_tree.bin");
+}
+
+// The tree CMake built into the compiled_tree library (-DTB_COMPILED_TREE)
+// against the interpreted forms of the same file: pointer nodes (text
+// exports only), the flat walk and predict_batch, then the generated code
+// one row at a time and as a batch, on synthetic rows of the tree's width
+void benchCompiledTree()
+{
+#ifndef TB_HAVE_COMPILED_TREE
+    cout << "not built; write a tree with ./bench --save-tree tree.txt (or use any "
+            "tree.bin) and configure with -DTB_COMPILED_TREE=<path>" << endl;
+#else
+    const string path = TB_COMPILED_TREE_FILE;
+    DecisionTree tree;
+    bool text = endsWith(path, ".txt");
+    if (!(text ? tree.import_text(path) : tree.load(path)))
+        throw runtime_error("Error: could not load the compiled tree's source " + path);
+    bool has_pointer = tree.root != nullptr;
+
+    vector<vector<double>> X_test;
+    vector<int> y_test;
+    size_t cols = max<size_t>(compiled_tree_feature_span, 1);
+    makeData(20000, cols, 2, X_test, y_test);
+    size_t rows = X_test.size();
+    vector<double> packed(rows * cols);
+    for (size_t r = 0; r < rows; r++)
+        copy(X_test[r].begin(), X_test[r].end(), packed.begin() + r * cols);
+
+    const int rounds = 20;
+    long pointer_sum = 0, flat_sum = 0, compiled_sum = 0;
+    double pointer_ns = numeric_limits<double>::quiet_NaN();
+    if (has_pointer) pointer_ns = timePredict(tree, X_test, rounds, pointer_sum);
+    tree.compile();
+    if (tree.compiled_size() != compiled_tree_nodes || tree.compiled_depth() != compiled_tree_depth)
+        throw runtime_error("Error: " + path + " changed since the compiled tree was built; rebuild");
+    double flat_ns = timePredict(tree, X_test, rounds, flat_sum);
+    vector<int> batch;
+    double batch_ns = timeBatch(tree, packed, rows, cols, 1, rounds, batch);
+
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < rows; i++) compiled_sum += compiled_tree_predict(packed.data() + i * cols);
+    auto t1 = chrono::steady_clock::now();
+    vector<int> compiled_batch(rows);
+    for (int r = 0; r < rounds; r++)
+        compiled_tree_predict_batch(packed.data(), rows, cols, compiled_batch.data());
+    auto t2 = chrono::steady_clock::now();
+    double compiled_ns = chrono::duration<double, nano>(t1 - t0).count() / (rounds * rows);
+    double compiled_batch_ns = chrono::duration<double, nano>(t2 - t1).count() / (rounds * rows);
+
+    // The generated code must route every row exactly as the flat walk
+    size_t mismatches = (compiled_sum != flat_sum);
+    for (size_t i = 0; i < rows; i++)
+        mismatches += (compiled_tree_predict(packed.data() + i * cols) != batch[i]) +
+                      (compiled_batch[i] != batch[i]);
+
+    record("compiled_tree/nodes", (double)compiled_tree_nodes, "count");
+    record("compiled_tree/predict_pointer", pointer_ns, "ns/sample");
+    record("compiled_tree/predict_flat", flat_ns, "ns/sample");
+    record("compiled_tree/predict_batch", batch_ns, "ns/sample");
+    record("compiled_tree/predict_compiled", compiled_ns, "ns/sample");
+    record("compiled_tree/predict_compiled_batch", compiled_batch_ns, "ns/sample");
+    record("compiled_tree/throughput_compiled_batch", 1e9 / compiled_batch_ns, "samples/s");
+    record("compiled_tree/mismatches", (double)mismatches, "count");
+
+    cout << compiled_tree_nodes << " nodes, depth " << compiled_tree_depth << " (" << path << ")"
+         << fixed << setprecision(2);
+    if (has_pointer) cout << "  pointer " << pointer_ns << " ns/sample";
+    cout << "  flat " << flat_ns << " ns/sample"
+         << "  batch " << batch_ns << " ns/sample"
+         << "  compiled " << compiled_ns << " ns/sample"
+         << "  compiled batch " << compiled_batch_ns << " ns/sample"
+         << (mismatches ? "  (MISMATCH)" : "") << endl;
+#endif
+}
+
+// Radiograph-like image whose class shows in its texture: TB images get
+// bright nodules scattered over the lung fields
+cv::Mat makeLabelledImage(int size, int label, unsigned seed) {
+    cv::Mat img = makeImage(size, size, seed);
+    if (label == 1) {
+        mt19937 rng(seed * 7919u + 1);
+        for (int k = 0; k < 40; k++) {
+            int ci = rng() % size, cj = size / 5 + rng() % (3 * size / 5), r = 3 + rng() % 8;
+            for (int i = max(0, ci - r); i < min(size, ci + r); i++) {
+                uchar* p = img.ptr<uchar>(i);
+                for (int j = max(0, cj - r); j < min(size, cj + r); j++)
+                    p[j] = (uchar)min(255, p[j] + 60);
+            }
+        }
+    }
+    return img;
+}
+
+// End to end on a synthetic dataset written to disk: the trainer's path
+// (ingest both class folders, running statistics, normalized centroids)
+// and image_processor's (ingest the test folder, folded scoring, threshold
+// sweep), timed as a whole, without the feature cache
+void benchEndToEnd() {
+    namespace fs = std::filesystem;
+    const int per_class = 100, test_images = 100, size = 512;
+    fs::path root = fs::temp_directory_path() / "tb_bench_dataset";
+    fs::remove_all(root);
+    const char* classes[] = {"Normal", "Tuberculosis"};
+    for (int label = 0; label < 2; label++) {
+        fs::create_directories(root / classes[label]);
+        for (int i = 0; i < per_class; i++) {
+            cv::imwrite((root / classes[label] / (to_string(i) + ".png")).string(),
+                        makeLabelledImage(size, label, 1000 * label + i));
+        }
+    }
+    fs::create_directories(root / "test");
+    for (int i = 0; i < test_images; i++) {
+        int label = i % 2;
+        cv::imwrite((root / "test" / (string(classes[label]) + "-" + to_string(i) + ".png")).string(),
+                    makeLabelledImage(size, label, 5000 + i));
+    }
+
+    PreprocessParams params;
+    size_t cols = (size_t)params.image_size * params.image_size;
+    ostringstream quiet;
+
+    auto t0 = chrono::steady_clock::now();
+    RunningStats per_class_stats[2] = {RunningStats(cols), RunningStats(cols)};
+    for (int label = 0; label < 2; label++) {
+        streamDirectory((root / classes[label]).string(), params,
+                        [&](const StreamedRow& r) { per_class_stats[label].add(r.features); },
+                        0, nullptr, quiet);
+    }
+    RunningStats all = per_class_stats[0];
+    all.merge(per_class_stats[1]);
+    vector<double> means = all.mean(), stdevs = all.stdev();
+    vector<double> centroids[2];
+    for (int label = 0; label < 2; label++) {
+        centroids[label].assign(cols, 0.0);
+        for (size_t j = 0; j < cols; j++)
+            if (stdevs[j] > 1e-10)
+                centroids[label][j] = (per_class_stats[label].mean()[j] - means[j]) / stdevs[j];
+    }
+    auto t1 = chrono::steady_clock::now();
+
+    CentroidScorer scorer(centroids[0].data(), centroids[1].data(), means.data(), stdevs.data(), cols);
+    vector<double> scores;
+    vector<int> labels;
+    streamDirectory((root / "test").string(), params,
+                    [&](const StreamedRow& r) {
+                        scores.push_back(scorer.score(r.features));
+                        labels.push_back(labelFromName(r.name));
+                    },
+                    0, nullptr, quiet);
+    SweepResult sweep = sweepThresholds(scores, labels);
+    auto t2 = chrono::steady_clock::now();
+    fs::remove_all(root);
+
+    double train_s = chrono::duration<double>(t1 - t0).count();
+    double eval_s = chrono::duration<double>(t2 - t1).count();
+    record("end_to_end/train", train_s * 1000, "ms");
+    record("end_to_end/train_throughput", 2 * per_class / train_s, "images/s");
+    record("end_to_end/eval", eval_s * 1000, "ms");
+    record("end_to_end/eval_throughput", test_images / eval_s, "images/s");
+    record("end_to_end/accuracy", sweep.best.accuracy * 100, "%");
+
+    cout << fixed << setprecision(1)
+         << "end to end  train " << 2 * per_class << " images " << train_s * 1000 << " ms ("
+         << 2 * per_class / train_s << " images/s)  eval " << test_images << " images "
+         << eval_s * 1000 << " ms (" << test_images / eval_s << " images/s)  accuracy "
+         << setprecision(2) << sweep.best.accuracy * 100 << "%" << endl;
+}
+
+// enhanceDirectory over radiograph-sized PNGs: decode, filter, encode and
+// write for each filter, whole and in parallel bands. Banded output must
+// match whole-image output file for file.
+void benchEnhance() {
+    namespace fs = std::filesystem;
+    const int images = 16, size = 2048;
+    fs::path root = fs::temp_directory_path() / "tb_bench_enhance";
+    fs::remove_all(root);
+    fs::create_directories(root / "in");
+    for (int i = 0; i < images; i++)
+        cv::imwrite((root / "in" / (to_string(i) + ".png")).string(), makeImage(size, size, 300 + i));
+
+    auto readAll = [](const fs::path& path) {
+        ifstream in(path, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    };
+
+    ostringstream quiet;
+    for (const char* name : {"sharpen", "unsharp", "clahe"}) {
+        EnhanceOptions options;
+        options.filter = parseEnhanceFilter(name);
+        double mp_s[2] = {0, 0};
+        for (int tiled = 0; tiled < 2; tiled++) {
+            if (tiled && options.filter == EnhanceFilter::CLAHE) continue;  // never banded
+            options.tile_rows = tiled ? 256 : 0;
+            EnhanceStats stats;
+            enhanceDirectory((root / "in").string(), (root / (tiled ? "tiled" : "whole")).string(),
+                             options, stats, quiet);
+            mp_s[tiled] = stats.seconds > 0 ? stats.megapixels / stats.seconds : 0.0;
+            record(string("enhance/") + name + (tiled ? "/tiled" : "/whole"), mp_s[tiled], "MP/s");
+        }
+
+        size_t mismatches = 0;
+        if (options.filter != EnhanceFilter::CLAHE) {
+            for (int i = 0; i < images; i++) {
+                string file = to_string(i) + ".png";
+                mismatches += readAll(root / "whole" / file) != readAll(root / "tiled" / file);
+            }
+            record(string("enhance/") + name + "/tile_mismatches", (double)mismatches, "count");
+        }
+
+        cout << left << setw(8) << name << right << fixed << setprecision(1)
+             << "  whole " << mp_s[0] << " MP/s";
+        if (options.filter != EnhanceFilter::CLAHE)
+            cout << "  tiled " << mp_s[1] << " MP/s" << (mismatches ? "  (MISMATCH)" : "");
+        cout << endl;
+    }
+    fs::remove_all(root);
+}
+
+int main(int argc, char** argv) {
+    try {
+        cv::Mat::setDefaultAllocator(&mat_allocator);
+
+        // --json FILE: also write every result to FILE (see writeJson)
+        // --only NAME: run only the named section; repeatable
+        // --save-tree FILE: write the depth-10 synthetic tree the tree
+        //   sections train (text if FILE ends in .txt, else binary) as a
+        //   source for -DTB_COMPILED_TREE, and exit
+        string json_path, save_tree;
+        vector<string> only;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--json" && i + 1 < argc) json_path = argv[++i];
+            else if (arg == "--only" && i + 1 < argc) only.push_back(argv[++i]);
+            else if (arg == "--save-tree" && i + 1 < argc) save_tree = argv[++i];
+            else throw runtime_error("Unknown option: " + arg +
+                                     "\nUsage: bench [--json FILE] [--only NAME]... [--save-tree FILE]");
+        }
+
+        vector<vector<double>> X, X_test;
+        vector<int> y, y_test;
+        makeData(4000, 256, 1, X, y);
+        makeData(20000, 256, 2, X_test, y_test);
+
+        size_t cols = X_test[0].size();
+        vector<double> packed(X_test.size() * cols);
+        for (size_t r = 0; r < X_test.size(); r++)
+            copy(X_test[r].begin(), X_test[r].end(), packed.begin() + r * cols);
+
+        if (!save_tree.empty()) {
+            DecisionTree tree(10, 2);
+            tree.train(X, y);
+            if (!(endsWith(save_tree, ".txt") ? tree.export_text(save_tree) : tree.save(save_tree)))
+                return 1;
+            cout << "Tree written to " << save_tree << endl;
+            return 0;
+        }
+
+        const vector<pair<string, function<void()>>> sections = {
+            {"split_search", [&] { benchSplitSearch(); }},
+            {"tree", [&] { benchTree(X, y, X_test, packed); }},
+            {"quantized", [&] { benchQuantized(X, y, X_test, y_test, packed); }},
+            {"forest", [&] { benchForest(X, y, X_test, y_test, packed); }},
+            {"training", [&] { benchTraining(); }},
+            {"preprocess", [&] { benchPreprocess(); }},
+            {"glcm", [&] { benchGlcm(); }},
+            {"extract", [&] { benchExtractor(); }},
+            {"scoring", [&] { benchScoring(); }},
+            {"model_files", [&] { benchModelFiles(X, y, X_test); }},
+            {"compiled_tree", [&] { benchCompiledTree(); }},
+            {"end_to_end", [&] { benchEndToEnd(); }},
+            {"enhance", [&] { benchEnhance(); }},
+        };
+        for (const string& name : only) {
+            bool known = false;
+            for (const auto& section : sections) known = known || section.first == name;
+            if (!known) {
+                string names;
+                for (const auto& section : sections) names += " " + section.first;
+                throw runtime_error("Unknown section: " + name + "\nSections:" + names);
+            }
+        }
+
+        vector<string> ran;
+        for (const auto& section : sections) {
+            if (!only.empty() && find(only.begin(), only.end(), section.first) == only.end()) continue;
+            section.second();
+            ran.push_back(section.first);
+        }
+
+        if (!json_path.empty()) {
+            writeJson(json_path, ran);
+            cout << results.size() << " results written to " << json_path << endl;
+        }
+        if (reportFailedChecks() > 0) return 1;
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "centroid_model.h"
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+struct CentroidPayload {
+    uint64_t num_features;
+    PreprocessParams preprocess;
+};
+static_assert(sizeof(CentroidPayload) % sizeof(double) == 0,
+              "centroid arrays must stay 8-byte aligned");
+
+void CentroidModel::save(const string& filename,
+                         const vector<double>& normal,
+                         const vector<double>& tb,
+                         const vector<double>& means,
+                         const vector<double>& stdevs,
+                         const PreprocessParams& preprocess)
+{
+    size_t n = normal.size();
+    if (tb.size() != n || means.size() != n || stdevs.size() != n) {
+        throw runtime_error("Error: centroid model arrays have different sizes");
+    }
+
+    CentroidPayload head;
+    head.num_features = n;
+    head.preprocess = preprocess;
+
+    vector<unsigned char> payload(sizeof(head) + 4 * n * sizeof(double));
+    unsigned char* p = payload.data();
+    memcpy(p, &head, sizeof(head));
+    p += sizeof(head);
+    for (const vector<double>* v : {&normal, &tb, &means, &stdevs}) {
+        memcpy(p, v->data(), n * sizeof(double));
+        p += n * sizeof(double);
+    }
+
+    writeModelFile(filename, MODEL_CENTROID, payload.data(), payload.size());
+}
+
+void CentroidModel::load(const string& filename) {
+    size_t size;
+    const unsigned char* payload = openModelFile(mapped, filename, MODEL_CENTROID, size);
+
+    CentroidPayload head;
+    if (size < sizeof(head)) {
+        throw runtime_error("Error: centroid model payload is truncated: " + filename);
+    }
+    memcpy(&head, payload, sizeof(head));
+    if (head.num_features == 0 ||
+        size != sizeof(head) + 4 * head.num_features * sizeof(double)) {
+        throw runtime_error("Error: centroid model size does not match its feature count: " + filename);
+    }
+
+    // The header is a multiple of 8 bytes and mappings are page aligned,
+    // so the arrays can be read in place as doubles
+    const double* arrays = (const double*)(payload + sizeof(head));
+    num_features = head.num_features;
+    preprocess = head.preprocess;
+    normal = arrays;
+    tb = arrays + num_features;
+    means = arrays + 2 * num_features;
+    stdevs = arrays + 3 * num_features;
+}
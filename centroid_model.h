@@ -0,0 +1,42 @@
+#ifndef CENTROID_MODEL_H
+#define CENTROID_MODEL_H
+
+#include <string>
+#include <vector>
+#include "image_processor.h"
+#include "model_file.h"
+
+// Nearest-centroid model written by trainer and read by image_processor:
+// the normalized class averages plus the z-score parameters and the
+// preprocessing they were computed with, in one MODEL_CENTROID file.
+//
+// Payload: CentroidPayload, then four arrays of num_features doubles
+// (normal, tb, means, stdevs). load() maps the file and the pointers below
+// refer straight into the mapping, so values arrive bit-exact and startup
+// cost does not grow with the number of features.
+class CentroidModel {
+public:
+    size_t num_features = 0;
+    PreprocessParams preprocess;
+
+    const double* normal = nullptr;   // average of normalized Normal samples
+    const double* tb = nullptr;       // average of normalized Tuberculosis samples
+    const double* means = nullptr;    // z-score means
+    const double* stdevs = nullptr;   // z-score standard deviations
+
+    // Throws std::runtime_error if the file is missing or fails validation
+    void load(const std::string& filename);
+
+    // Throws std::runtime_error on I/O failure or mismatched sizes
+    static void save(const std::string& filename,
+                     const std::vector<double>& normal,
+                     const std::vector<double>& tb,
+                     const std::vector<double>& means,
+                     const std::vector<double>& stdevs,
+                     const PreprocessParams& preprocess);
+
+private:
+    MappedFile mapped;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "centroid_scorer.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SCORER_X86 1
+#endif
+
+using namespace std;
+
+// All kernels accumulate in double, like the dot() they replace; they
+// differ from each other only in summation order.
+
+static double dotScalar(const double* w, const feature_t* x, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += w[i] * x[i];
+        s1 += w[i + 1] * x[i + 1];
+        s2 += w[i + 2] * x[i + 2];
+        s3 += w[i + 3] * x[i + 3];
+    }
+    for (; i < n; i++) s0 += w[i] * x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef SCORER_X86
+
+// SSE2 is part of x86-64, so this needs no runtime check
+static double dotSSE2(const double* w, const float* x, size_t n) {
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 xf = _mm_loadu_ps(x + i);
+        __m128d lo = _mm_cvtps_pd(xf);
+        __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(xf, xf));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(w + i), lo));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(w + i + 2), hi));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    double s = lanes[0] + lanes[1];
+    for (; i < n; i++) s += w[i] * x[i];
+    return s;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SCORER_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define SCORER_HAVE_AVX2 1
+#elif defined(__AVX2__)
+#define SCORER_AVX2_TARGET
+#define SCORER_HAVE_AVX2 1
+#endif
+
+#ifdef SCORER_HAVE_AVX2
+// 8 features per iteration into two independent FMA chains
+SCORER_AVX2_TARGET
+static double dotAVX2(const double* w, const float* x, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 xf = _mm256_loadu_ps(x + i);
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(xf));
+        __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(xf, 1));
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(w + i), lo, acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(w + i + 4), hi, acc1);
+    }
+    __m256d acc = _mm256_add_pd(acc0, acc1);
+    __m128d sum2 = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum2);
+    double s = lanes[0] + lanes[1];
+    for (; i < n; i++) s += w[i] * x[i];
+    return s;
+}
+
+static bool cpuHasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return true;  // compiled with /arch:AVX2
+#endif
+}
+#endif
+
+#endif // SCORER_X86
+
+// Vector kernels exist for float features; anything else stays scalar
+template <typename T>
+static const char* pickKernel(double (*&dot)(const double*, const T*, size_t)) {
+    dot = dotScalar;
+    return "scalar";
+}
+
+#ifdef SCORER_X86
+template <>
+const char* pickKernel<float>(double (*&dot)(const double*, const float*, size_t)) {
+#ifdef SCORER_HAVE_AVX2
+    if (cpuHasAVX2()) {
+        dot = dotAVX2;
+        return "avx2";
+    }
+#endif
+    dot = dotSSE2;
+    return "sse2";
+}
+#endif
+
+CentroidScorer::CentroidScorer(const double* normal, const double* tb,
+                               const double* means, const double* stdevs, size_t n)
+    : weights(n)
+{
+    // Fold (x - mean) / stdev into the class difference, as
+    // normalizeWithParams did per element before the two dot products
+    for (size_t j = 0; j < n; j++) {
+        if (stdevs[j] > 1e-10) {
+            weights[j] = (tb[j] - normal[j]) / stdevs[j];
+            bias -= weights[j] * means[j];
+        } else {
+            weights[j] = 0.0;
+        }
+    }
+
+    kernel_name = pickKernel<feature_t>(dot);
+}
+
+CentroidScorer::CentroidScorer(const CentroidModel& model)
+    : CentroidScorer(model.normal, model.tb, model.means, model.stdevs, model.num_features) {}
@@ -0,0 +1,37 @@
+#ifndef CENTROID_SCORER_H
+#define CENTROID_SCORER_H
+
+#include <vector>
+#include <cstddef>
+#include "centroid_model.h"
+#include "feature_matrix.h"
+
+// Centroid score with the z-score folded into the weights. For raw
+// preprocessed features x (before normalization),
+//   dot(z(x), tb) - dot(z(x), normal) == dot(weights, x) + bias
+// with weights[j] = (tb[j] - normal[j]) / stdevs[j] and
+// bias = -sum(weights[j] * means[j]). Features whose stdev is ~0 normalize
+// to 0 and get weight 0. Scoring is then one vectorized pass over x.
+class CentroidScorer {
+public:
+    CentroidScorer(const double* normal, const double* tb,
+                   const double* means, const double* stdevs, size_t n);
+    explicit CentroidScorer(const CentroidModel& model);
+
+    // score > threshold means Tuberculosis
+    double score(const feature_t* x) const { return dot(weights.data(), x, weights.size()) + bias; }
+
+    size_t size() const { return weights.size(); }
+
+    // Kernel picked for this CPU: "avx2", "sse2" or "scalar"
+    const char* kernel() const { return kernel_name; }
+
+private:
+    std::vector<double> weights;
+    double bias = 0.0;
+
+    double (*dot)(const double* w, const feature_t* x, size_t n) = nullptr;
+    const char* kernel_name = "scalar";
+};
+
+#endif
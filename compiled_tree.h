@@ -0,0 +1,26 @@
+#ifndef COMPILED_TREE_H
+#define COMPILED_TREE_H
+
+#include <cstddef>
+
+// A DecisionTree compiled to C++ by tree_codegen (DecisionTree::export_cpp):
+// every node is an if/else with its feature index and threshold as
+// immediates, so prediction is straight-line branches with no node loads.
+// Configuring with -DTB_COMPILED_TREE=tree.bin generates the definitions
+// from that model file and builds them into the compiled_tree library.
+//
+// Predictions equal DecisionTree::predict() and predict_batch() on the
+// tree it was generated from (the compiled form, float thresholds).
+
+// Nodes and depth of the source tree; rows need at least
+// compiled_tree_feature_span features
+extern const size_t compiled_tree_nodes;
+extern const int compiled_tree_depth;
+extern const size_t compiled_tree_feature_span;
+
+int compiled_tree_predict(const double* x);
+
+// Row-major rows x cols matrix into out[0, rows)
+void compiled_tree_predict_batch(const double* X, size_t rows, size_t cols, int* out);
+
+#endif
@@ -0,0 +1,251 @@
+#include "cross_validation.h"
+#include <algorithm>
+#include <random>
+#include <iomanip>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "running_stats.h"
+#include "centroid_scorer.h"
+#include "decision_tree.h"
+#include "evaluation.h"
+#include "task_pool.h"
+#include "profiler.h"
+
+using namespace std;
+
+// ============ Folds ============
+
+vector<vector<size_t>> stratifiedFolds(const vector<int>& labels, int folds, uint64_t seed)
+{
+    if (folds < 2) throw runtime_error("Error: cross-validation needs at least 2 folds");
+    if (labels.size() < (size_t)folds) {
+        throw runtime_error("Error: " + to_string(labels.size()) + " samples cannot fill " +
+                            to_string(folds) + " folds");
+    }
+
+    vector<vector<size_t>> re(folds);
+    mt19937_64 rng(seed);
+    size_t next = 0;
+    for (int cls = 0; cls <= 1; cls++) {
+        vector<size_t> rows;
+        for (size_t i = 0; i < labels.size(); i++)
+            if (labels[i] == cls) rows.push_back(i);
+        shuffle(rows.begin(), rows.end(), rng);
+        for (size_t i : rows) re[next++ % folds].push_back(i);
+    }
+    for (auto& fold : re) sort(fold.begin(), fold.end());
+    return re;
+}
+
+// ============ Fitting ============
+
+namespace {
+
+// Tallies "predicted 1" against the truth for one fold's test rows
+struct Confusion {
+    size_t tp = 0, fp = 0, tn = 0, fn = 0;
+
+    void add(int predicted, int truth) {
+        if (predicted == 1) (truth == 1 ? tp : fp)++;
+        else (truth == 1 ? fn : tn)++;
+    }
+
+    FoldMetrics metrics() const {
+        FoldMetrics m;
+        size_t n = tp + fp + tn + fn;
+        if (n) m.accuracy = (double)(tp + tn) / n;
+        if (tp + fp) m.precision = (double)tp / (tp + fp);
+        if (tp + fn) m.recall = (double)tp / (tp + fn);
+        return m;
+    }
+};
+
+// Every row whose index is not in `test` (ascending), i.e. the training
+// rows of that fold
+vector<size_t> complement(const vector<size_t>& test, size_t rows)
+{
+    vector<size_t> re;
+    re.reserve(rows - test.size());
+    size_t k = 0;
+    for (size_t i = 0; i < rows; i++) {
+        if (k < test.size() && test[k] == i) k++;
+        else re.push_back(i);
+    }
+    return re;
+}
+
+// Same walk as DecisionTree::predict_flat, straight over a float row
+int predictRow(const FlatNode* nodes, const feature_t* x)
+{
+    uint32_t i = 0;
+    while (nodes[i].feature >= 0)
+        i = nodes[i].child + !(x[nodes[i].feature] < nodes[i].threshold);
+    return (int)nodes[i].child;
+}
+
+// Normal and TB statistics of one fold's own rows
+struct FoldStats {
+    RunningStats normal, positive;
+};
+
+// As trainer does it, except that the class statistics of the training
+// rows are merged from the other folds' (always in fold order) rather than
+// recomputed: per-class running statistics merged into the z-score
+// parameters, then the decision threshold that maximizes accuracy on the
+// same training rows
+void fitCentroid(const FeatureMatrix& X, const vector<int>& labels,
+                 const vector<FoldStats>& fold_stats, size_t fold,
+                 const vector<size_t>& train, const vector<size_t>& test, FoldResult& result)
+{
+    PROFILE_SCOPE("cv_centroid");
+    RunningStats normal(X.cols), positive(X.cols);
+    for (size_t g = 0; g < fold_stats.size(); g++) {
+        if (g == fold) continue;
+        normal.merge(fold_stats[g].normal);
+        positive.merge(fold_stats[g].positive);
+    }
+    RunningStats all = normal;
+    all.merge(positive);
+    vector<double> means = all.mean();
+    vector<double> stdevs = all.stdev();
+    vector<double> normal_avg = normalizedCentroid(normal, means, stdevs);
+    vector<double> positive_avg = normalizedCentroid(positive, means, stdevs);
+    CentroidScorer scorer(normal_avg.data(), positive_avg.data(), means.data(), stdevs.data(), X.cols);
+
+    vector<double> scores(train.size());
+    vector<int> truth(train.size());
+    for (size_t k = 0; k < train.size(); k++) {
+        scores[k] = scorer.score(X.row(train[k]));
+        truth[k] = labels[train[k]];
+    }
+    result.centroid_threshold = sweepThresholds(scores, truth).best.threshold;
+
+    Confusion confusion;
+    for (size_t i : test)
+        confusion.add(scorer.score(X.row(i)) > result.centroid_threshold ? 1 : 0, labels[i]);
+    result.centroid = confusion.metrics();
+}
+
+void fitTree(const vector<double>& columns, const FeatureMatrix& X, const vector<int>& labels,
+             const vector<size_t>& train, const vector<size_t>& test,
+             const CrossValidationOptions& options, FoldResult& result)
+{
+    PROFILE_SCOPE("cv_tree");
+    DecisionTree tree(options.tree_depth, options.tree_min_samples);
+    tree.train_columns(columns.data(), labels.data(), X.rows, X.cols, train, 1);
+    tree.compile();
+
+    Confusion confusion;
+    for (size_t i : test) confusion.add(predictRow(tree.compiled_nodes(), X.row(i)), labels[i]);
+    result.tree = confusion.metrics();
+}
+
+}  // namespace
+
+// The centroid fits read X as it is, and each row enters the running
+// statistics once, for its own fold. The trees share one column-major
+// double copy of X, made once, as RandomForest does; each fold's tree sees
+// its training rows through the sample list train_columns takes.
+vector<FoldResult> crossValidate(const FeatureMatrix& X, const vector<int>& labels,
+                                 const CrossValidationOptions& options)
+{
+    if (labels.size() != X.rows) {
+        throw runtime_error("Error: " + to_string(labels.size()) + " labels for " +
+                            to_string(X.rows) + " samples");
+    }
+    for (int label : labels) {
+        if (label != 0 && label != 1) throw runtime_error("Error: cross-validation labels must be 0 or 1");
+    }
+    vector<vector<size_t>> folds = stratifiedFolds(labels, options.folds, options.seed);
+
+    vector<double> columns(X.rows * X.cols);
+    for (size_t i = 0; i < X.rows; i++) {
+        const feature_t* row = X.row(i);
+        for (size_t j = 0; j < X.cols; j++)
+            columns[j * X.rows + i] = row[j];
+    }
+
+    vector<vector<size_t>> train(folds.size());
+    for (size_t f = 0; f < folds.size(); f++) train[f] = complement(folds[f], X.rows);
+
+    vector<FoldResult> results(folds.size());
+    vector<FoldStats> fold_stats(folds.size(), {RunningStats(X.cols), RunningStats(X.cols)});
+    // Groups outlive the pool, whose destructor finishes running tasks
+    TaskPool::Group trees, stats, centroids;
+    TaskPool pool(options.threads);
+    for (size_t f = 0; f < folds.size(); f++) {
+        results[f].train_size = train[f].size();
+        results[f].test_size = folds[f].size();
+        pool.run(trees, [&, f] { fitTree(columns, X, labels, train[f], folds[f], options, results[f]); });
+        pool.run(stats, [&, f] {
+            PROFILE_SCOPE("cv_fold_stats");
+            for (size_t i : folds[f])
+                (labels[i] == 1 ? fold_stats[f].positive : fold_stats[f].normal).add(X.row(i));
+        });
+    }
+    pool.wait(stats);
+    for (size_t f = 0; f < folds.size(); f++) {
+        pool.run(centroids, [&, f] {
+            fitCentroid(X, labels, fold_stats, f, train[f], folds[f], results[f]);
+        });
+    }
+    pool.wait(centroids);
+    pool.wait(trees);
+    return results;
+}
+
+// ============ Report ============
+
+// Mean and sample variance (n - 1) of one metric over the folds
+static pair<double, double> meanVariance(const vector<FoldResult>& results,
+                                         double (*metric)(const FoldResult&))
+{
+    double mean = 0, m2 = 0;
+    for (size_t k = 0; k < results.size(); k++) {
+        double d = metric(results[k]) - mean;
+        mean += d / (k + 1);
+        m2 += d * (metric(results[k]) - mean);
+    }
+    return {mean, results.size() > 1 ? m2 / (results.size() - 1) : 0.0};
+}
+
+void printCrossValidation(const vector<FoldResult>& results, ostream& out)
+{
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+
+    out << "\n=== " << results.size() << "-FOLD CROSS-VALIDATION (stratified) ===" << endl
+        << fixed << setprecision(2)
+        << "fold   train   test  threshold | centroid acc   prec    rec |     tree acc   prec    rec" << endl;
+    for (size_t f = 0; f < results.size(); f++) {
+        const FoldResult& r = results[f];
+        out << setw(4) << f + 1 << setw(8) << r.train_size << setw(7) << r.test_size
+            << setw(11) << setprecision(4) << r.centroid_threshold << setprecision(2) << " |"
+            << setw(13) << r.centroid.accuracy * 100 << setw(7) << r.centroid.precision * 100
+            << setw(7) << r.centroid.recall * 100 << " |"
+            << setw(13) << r.tree.accuracy * 100 << setw(7) << r.tree.precision * 100
+            << setw(7) << r.tree.recall * 100 << endl;
+    }
+
+    struct Row { const char* name; double (*metric)(const FoldResult&); };
+    const Row rows[] = {
+        {"centroid accuracy", [](const FoldResult& r) { return r.centroid.accuracy; }},
+        {"centroid precision", [](const FoldResult& r) { return r.centroid.precision; }},
+        {"centroid recall", [](const FoldResult& r) { return r.centroid.recall; }},
+        {"tree accuracy", [](const FoldResult& r) { return r.tree.accuracy; }},
+        {"tree precision", [](const FoldResult& r) { return r.tree.precision; }},
+        {"tree recall", [](const FoldResult& r) { return r.tree.recall; }},
+    };
+    out << "\nmetric                  mean %   variance    std %" << endl;
+    for (const Row& row : rows) {
+        pair<double, double> mv = meanVariance(results, row.metric);
+        out << left << setw(20) << row.name << right
+            << setw(10) << setprecision(2) << mv.first * 100
+            << setw(11) << scientific << setprecision(2) << mv.second << fixed
+            << setw(9) << setprecision(2) << sqrt(mv.second) * 100 << endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
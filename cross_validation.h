@@ -0,0 +1,59 @@
+#ifndef CROSS_VALIDATION_H
+#define CROSS_VALIDATION_H
+
+#include <vector>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+#include "feature_matrix.h"
+
+// Stratified k-fold cross-validation of the centroid model and a
+// DecisionTree over one decoded feature matrix. Folds are lists of row
+// indices into the caller's matrix, which is only read; every fold's
+// centroid fit and tree fit runs as its own task on a TaskPool, so all
+// folds train and evaluate at once.
+
+struct CrossValidationOptions {
+    int folds = 10;
+    uint64_t seed = 1;          // fold assignment
+    int tree_depth = 5;         // DecisionTree defaults
+    int tree_min_samples = 2;
+    int threads = 0;            // <= 0: one per core
+};
+
+// "Tuberculosis" (label 1) is the positive class. Precision is 0 when
+// nothing is predicted positive, recall when there are no positives.
+struct FoldMetrics {
+    double accuracy = 0;
+    double precision = 0;
+    double recall = 0;
+};
+
+struct FoldResult {
+    size_t train_size = 0;
+    size_t test_size = 0;
+    // Picked by sweepThresholds on the fold's training rows, never on the
+    // rows it is tested on
+    double centroid_threshold = 0;
+    FoldMetrics centroid;
+    FoldMetrics tree;
+};
+
+// Test rows of each of `folds` folds, ascending. Each class's rows are
+// shuffled (from seed) and dealt round robin, continuing from fold to fold
+// across classes, so every fold holds its class share to within one row
+// and fold sizes differ by at most one. Throws std::runtime_error if there
+// are fewer rows than folds or fewer than two folds.
+std::vector<std::vector<size_t>> stratifiedFolds(const std::vector<int>& labels,
+                                                 int folds, uint64_t seed);
+
+// Train on all folds but one and test on that one, for every fold. labels
+// must be 0 or 1. Results are in fold order and do not depend on the
+// thread count. Throws std::runtime_error on bad input.
+std::vector<FoldResult> crossValidate(const FeatureMatrix& X, const std::vector<int>& labels,
+                                      const CrossValidationOptions& options);
+
+// Per-fold table, then the mean and sample variance of each metric
+void printCrossValidation(const std::vector<FoldResult>& results, std::ostream& out);
+
+#endif
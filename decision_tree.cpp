@@ -1,6 +1,17 @@
 #include "decision_tree.h"
 #include <limits>
 #include <cmath>
+#include <algorithm>
+#include <utility>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <iomanip>
+#include <cstdio>
+#include <stdexcept>
+#include "model_file.h"
+#include "task_pool.h"
 using namespace std;
 
 // ============ Node Constructor ============
@@ -15,69 +26,273 @@ Node::Node()
 DecisionTree::DecisionTree(int depth, int min_s)
     : root(nullptr), max_depth(depth), min_samples(min_s) {}
 
-double DecisionTree::gini(const vector<int>& labels) {
-    int count0 = 0, count1 = 0;
-    for (int y : labels) (y == 0) ? count0++ : count1++;
+// Nodes live in the tree's own pool; a deque never moves existing
+// elements on push_back, so Node* links stay valid until clear().
+Node* DecisionTree::new_node() {
+    if (node_mutex) {
+        lock_guard<mutex> lock(*node_mutex);
+        pool.emplace_back();
+        return &pool.back();
+    }
+    pool.emplace_back();
+    return &pool.back();
+}
+
+void DecisionTree::clear() {
+    root = nullptr;
+    pool.clear();
+    flat.clear();
+    flat_nodes = nullptr;
+    flat_size = 0;
+    flat_depth = 0;
+    bin_flat.clear();
+    mapped.close();
+}
 
-    double p0 = (double)count0 / labels.size();
-    double p1 = (double)count1 / labels.size();
+double DecisionTree::gini(size_t count0, size_t count1) {
+    size_t n = count0 + count1;
+    double p0 = (double)count0 / n;
+    double p1 = (double)count1 / n;
 
     return 1.0 - (p0*p0 + p1*p1);
 }
 
-int DecisionTree::most_common(const vector<int>& labels) {
-    int count0 = 0, count1 = 0;
-    for (int y : labels) (y == 0) ? count0++ : count1++;
+int DecisionTree::most_common(size_t count0, size_t count1) {
     return (count1 > count0) ? 1 : 0;
 }
 
-Node* DecisionTree::build(const vector<vector<double>>& X,
-                          const vector<int>& y,
-                          int depth)
+void DecisionTree::count_labels(size_t begin, size_t end,
+                                size_t& count0, size_t& count1)
 {
-    Node* node = new Node();
+    count0 = count1 = 0;
+    for (size_t k = begin; k < end; k++)
+        (train_labels[index[k]] == 0) ? count0++ : count1++;
+}
 
-    // Stop conditions
-    if (depth >= max_depth || y.size() <= min_samples || gini(y) == 0.0) {
-        node->is_leaf = true;
-        node->predicted_class = most_common(y);
-        return node;
+// ============ Training ============
+
+// Nodes with at least this many samples search their features as parallel
+// blocks while the tree is still too shallow to give every thread its own
+// subtree
+static const size_t SPLIT_TASK_MIN_SAMPLES = 2048;
+static const int SPLIT_TASK_MIN_FEATURES = 16;    // per block
+
+// Nodes with at least this many samples build their left subtree as a task
+static const size_t SUBTREE_TASK_MIN_SAMPLES = 256;
+
+// Sort-once split search over the given features (in increasing order).
+// Each feature is sorted a single time, then swept left to right while the
+// class counts on each side are updated, so every distinct value is scored
+// as a threshold (x < t goes left) in O(1). Ties resolve exactly like the
+// old exhaustive search: lowest feature first, then the threshold whose
+// first occurrence in X comes earliest. `best` is only replaced by a
+// strictly better split, so scanning feature ranges in order and merging
+// the same way gives the same answer as one scan.
+void DecisionTree::scan_features(size_t begin, size_t end,
+                                 const int* features, size_t feature_count,
+                                 size_t total0, size_t total1,
+                                 pair<double, size_t>* sorted,
+                                 SplitCandidate& best)
+{
+    if (binner) {
+        scan_bins(begin, end, features, feature_count, total0, total1, best);
+        return;
     }
 
-    // Search for best split
-    int best_feature = -1;
-    double best_threshold = 0.0;
-    double best_gini = numeric_limits<double>::infinity();
-
-    for (int f = 0; f < X[0].size(); f++) {
-        for (int i = 0; i < X.size(); i++) {
-            double t = X[i][f];
-
-            vector<int> left_y, right_y;
-            for (int j = 0; j < X.size(); j++) {
-                if (X[j][f] < t)
-                    left_y.push_back(y[j]);
-                else
-                    right_y.push_back(y[j]);
+    size_t n = end - begin;
+
+    for (size_t fi = 0; fi < feature_count; fi++) {
+        int f = features[fi];
+        const double* column = &train_cols[f * n_samples];
+        for (size_t k = 0; k < n; k++) {
+            size_t i = index[begin + k];
+            sorted[k] = {column[i], i};
+        }
+        sort(sorted, sorted + n);
+
+        double f_gini = numeric_limits<double>::infinity();
+        double f_threshold = 0.0;
+        size_t f_first = n_samples;
+
+        size_t left0 = 0, left1 = 0;
+        for (size_t k = 0; k < n; k++) {
+            double t = sorted[k].first;
+
+            // Start of a new run of equal values: everything before k is < t
+            if (k > 0 && sorted[k-1].first < t) {
+                size_t right0 = total0 - left0, right1 = total1 - left1;
+                size_t n_left = k, n_right = n - k;
+
+                double g = (n_left * gini(left0, left1) +
+                            n_right * gini(right0, right1))
+                            / n;
+
+                // sorted[k] holds the earliest sample with this value
+                if (g < f_gini || (g == f_gini && sorted[k].second < f_first)) {
+                    f_gini = g;
+                    f_threshold = t;
+                    f_first = sorted[k].second;
+                }
             }
 
-            if (left_y.empty() || right_y.empty()) continue;
+            (train_labels[sorted[k].second] == 0) ? left0++ : left1++;
+        }
+
+        if (f_gini < best.gini) {
+            best.gini = f_gini;
+            best.feature = f;
+            best.threshold = f_threshold;
+        }
+    }
+}
 
-            double g = (left_y.size() * gini(left_y) +
-                        right_y.size() * gini(right_y))
-                        / y.size();
+// Histogram split search over bin indices: one pass over the node's
+// samples per feature counts each class per bin, then a sweep over the
+// (at most 256) bins scores every boundary "bin < b". No sorting, and the
+// samples' bins are one byte each. best.threshold holds the bin b.
+void DecisionTree::scan_bins(size_t begin, size_t end,
+                             const int* features, size_t feature_count,
+                             size_t total0, size_t total1,
+                             SplitCandidate& best)
+{
+    size_t n = end - begin;
+    uint32_t hist[FeatureBinner::MAX_BINS][2];
+
+    for (size_t fi = 0; fi < feature_count; fi++) {
+        int f = features[fi];
+        int bins = binner->bin_count(f);
+        const uint8_t* column = &train_bins[f * n_samples];
+
+        memset(hist, 0, bins * sizeof(hist[0]));
+        for (size_t k = begin; k < end; k++) {
+            size_t i = index[k];
+            hist[column[i]][train_labels[i] != 0]++;
+        }
 
-            if (g < best_gini) {
-                best_gini = g;
-                best_feature = f;
-                best_threshold = t;
+        size_t left0 = hist[0][0], left1 = hist[0][1];
+        for (int b = 1; b < bins; b++) {
+            size_t n_left = left0 + left1;
+            if (n_left == n) break;     // nothing in the higher bins
+            if (hist[b][0] + hist[b][1] > 0 && n_left > 0) {
+                size_t right0 = total0 - left0, right1 = total1 - left1;
+                double g = (n_left * gini(left0, left1) +
+                            (n - n_left) * gini(right0, right1))
+                            / n;
+                if (g < best.gini) {
+                    best.gini = g;
+                    best.feature = f;
+                    best.threshold = b;
+                }
             }
+            left0 += hist[b][0];
+            left1 += hist[b][1];
         }
     }
+}
+
+// splitmix64 step: a well-mixed 64-bit value from any input, used to give
+// every node its own random stream
+static uint64_t mixSeed(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// k distinct features out of n in increasing order (Floyd's algorithm)
+static void sampleFeatures(uint64_t node_seed, size_t n, size_t k, vector<int>& out) {
+    vector<char> chosen(n, 0);
+    uint64_t state = node_seed;
+    for (size_t j = n - k; j < n; j++) {
+        state = mixSeed(state);
+        size_t t = (size_t)(state % (j + 1));
+        chosen[chosen[t] ? j : t] = 1;
+    }
+    out.clear();
+    for (size_t f = 0; f < n; f++) {
+        if (chosen[f]) out.push_back((int)f);
+    }
+}
+
+bool DecisionTree::best_split(size_t begin, size_t end, int depth, uint64_t node_seed,
+                              int& best_feature,
+                              double& best_threshold)
+{
+    size_t n = end - begin;
+    size_t total0, total1;
+    count_labels(begin, end, total0, total1);
+
+    // Candidate features, always in increasing order
+    vector<int> subset;
+    const int* features = all_features.data();
+    size_t feature_count = n_features;
+    if (max_features > 0 && (size_t)max_features < n_features) {
+        sampleFeatures(node_seed, n_features, max_features, subset);
+        features = subset.data();
+        feature_count = subset.size();
+    }
+
+    SplitCandidate best;
+    int threads = task_pool ? task_pool->size() : 1;
+    int blocks = min(threads * 4, (int)feature_count / SPLIT_TASK_MIN_FEATURES);
+
+    if (task_pool && n >= SPLIT_TASK_MIN_SAMPLES && blocks > 1 &&
+        depth < 30 && (1 << depth) < threads) {
+        // Each block sorts into its thread's scratch and reports its best;
+        // merging in feature order keeps the lowest-feature tie-break
+        vector<SplitCandidate> found(blocks);
+        TaskPool::Group group;
+        for (int b = 0; b < blocks; b++) {
+            size_t f_begin = feature_count * b / blocks;
+            size_t f_end = feature_count * (b + 1) / blocks;
+            task_pool->run(group, [this, begin, end, features, f_begin, f_end, total0, total1, b, &found] {
+                pair<double, size_t>* sorted =
+                    binner ? nullptr : thread_scratch[task_pool->thread_index()].data();
+                scan_features(begin, end, features + f_begin, f_end - f_begin,
+                              total0, total1, sorted, found[b]);
+            });
+        }
+        task_pool->wait(group);
+        for (const SplitCandidate& c : found) {
+            if (c.gini < best.gini) best = c;
+        }
+    } else {
+        // This node's slice of scratch is free until its children start
+        scan_features(begin, end, features, feature_count, total0, total1,
+                      binner ? nullptr : scratch.data() + begin, best);
+    }
+
+    best_feature = best.feature;
+    best_threshold = best.threshold;
+    return best_feature != -1;
+}
+
+// Build the subtree for the samples index[begin, end).
+// Children are formed by partitioning that slice of the index permutation
+// in place, so no rows are ever copied.
+Node* DecisionTree::build(size_t begin, size_t end, int depth, uint64_t node_seed)
+{
+    Node* node = new_node();
+
+    size_t count0, count1;
+    count_labels(begin, end, count0, count1);
+
+    // Stop conditions
+    if (depth >= max_depth || end - begin <= (size_t)min_samples ||
+        gini(count0, count1) == 0.0) {
+        node->is_leaf = true;
+        node->predicted_class = most_common(count0, count1);
+        return node;
+    }
+
+    // Search for best split
+    int best_feature = -1;
+    double best_threshold = 0.0;
+    best_split(begin, end, depth, node_seed, best_feature, best_threshold);
 
     if (best_feature == -1) { // No valid split
         node->is_leaf = true;
-        node->predicted_class = most_common(y);
+        node->predicted_class = most_common(count0, count1);
         return node;
     }
 
@@ -85,32 +300,156 @@ Node* DecisionTree::build(const vector<vector<double>>& X,
     node->threshold = best_threshold;
 
     // Split data
-    vector<vector<double>> left_X, right_X;
-    vector<int> left_y, right_y;
-
-    for (int i = 0; i < X.size(); i++) {
-        if (X[i][best_feature] < best_threshold) {
-            left_X.push_back(X[i]);
-            left_y.push_back(y[i]);
-        } else {
-            right_X.push_back(X[i]);
-            right_y.push_back(y[i]);
-        }
+    size_t mid;
+    if (binner) {
+        // Split on the bin, but store the raw edge it stands for
+        const uint8_t* column = &train_bins[best_feature * n_samples];
+        int b = (int)best_threshold;
+        mid = partition(index.begin() + begin, index.begin() + end,
+                        [&](size_t i) { return column[i] < b; })
+              - index.begin();
+        node->threshold = binner->edge(best_feature, b);
+    } else {
+        const double* column = &train_cols[best_feature * n_samples];
+        mid = partition(index.begin() + begin, index.begin() + end,
+                        [&](size_t i) { return column[i] < best_threshold; })
+              - index.begin();
     }
 
-    node->left = build(left_X, left_y, depth+1);
-    node->right = build(right_X, right_y, depth+1);
+    // Children's random streams depend only on their parent's
+    uint64_t left_seed = mixSeed(node_seed ^ 1), right_seed = mixSeed(node_seed ^ 2);
+
+    // Disjoint index slices, so the subtrees can be built concurrently
+    if (task_pool && end - begin >= SUBTREE_TASK_MIN_SAMPLES) {
+        TaskPool::Group group;
+        task_pool->run(group, [this, node, begin, mid, depth, left_seed] {
+            node->left = build(begin, mid, depth+1, left_seed);
+        });
+        node->right = build(mid, end, depth+1, right_seed);
+        task_pool->wait(group);
+    } else {
+        node->left = build(begin, mid, depth+1, left_seed);
+        node->right = build(mid, end, depth+1, right_seed);
+    }
 
     return node;
 }
 
 void DecisionTree::train(const vector<vector<double>>& X,
-                         const vector<int>& y)
+                         const vector<int>& y, int threads)
+{
+    clear();
+    if (X.empty()) return;
+
+    // One column-major copy of X: each feature's values are contiguous
+    // for the split search, and it is the only copy made during training.
+    n_samples = X.size();
+    n_features = X[0].size();
+    train_X.resize(n_samples * n_features);
+    for (size_t i = 0; i < n_samples; i++)
+        for (size_t f = 0; f < n_features; f++)
+            train_X[f * n_samples + i] = X[i][f];
+    train_y = y;
+    train_cols = train_X.data();
+    train_labels = train_y.data();
+
+    index.resize(n_samples);
+    for (size_t i = 0; i < n_samples; i++) index[i] = i;
+
+    fit(threads);
+}
+
+void DecisionTree::train_binned(const BinnedMatrix& X, const vector<int>& y,
+                                const FeatureBinner& bins, int threads)
+{
+    clear();
+    if (X.rows == 0) return;
+    if (X.cols != bins.size()) {
+        cerr << "Error: binned matrix has " << X.cols << " features but the bins have "
+             << bins.size() << "\n";
+        return;
+    }
+
+    // Column-major copy: each feature's bins are contiguous for the
+    // histogram pass, at one byte per value
+    n_samples = X.rows;
+    n_features = X.cols;
+    train_bins.resize(n_samples * n_features);
+    for (size_t i = 0; i < n_samples; i++) {
+        const uint8_t* row = X.row(i);
+        for (size_t f = 0; f < n_features; f++)
+            train_bins[f * n_samples + i] = row[f];
+    }
+    train_y = y;
+    train_labels = train_y.data();
+    binner = &bins;
+
+    index.resize(n_samples);
+    for (size_t i = 0; i < n_samples; i++) index[i] = i;
+
+    fit(threads);
+    compile_bins(bins);
+}
+
+void DecisionTree::train_columns(const double* columns, const int* y,
+                                 size_t rows, size_t cols,
+                                 vector<size_t> samples, int threads)
+{
+    clear();
+    if (samples.empty() || cols == 0) return;
+
+    n_samples = rows;
+    n_features = cols;
+    train_cols = columns;
+    train_labels = y;
+    index = std::move(samples);
+
+    fit(threads);
+}
+
+// Build from train_cols/train_labels over the samples in index
+void DecisionTree::fit(int threads)
 {
-    root = build(X, y, 0);
+    // Histogram search (train_binned) never sorts, so needs no scratch
+    if (!binner) scratch.resize(index.size());
+    all_features.resize(n_features);
+    for (size_t f = 0; f < n_features; f++) all_features[f] = (int)f;
+
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    if (threads > 1) {
+        TaskPool pool(threads);
+        mutex nodes;
+        task_pool = &pool;
+        node_mutex = &nodes;
+        if (!binner) thread_scratch.assign(threads, vector<pair<double, size_t>>(index.size()));
+
+        try {
+            root = build(0, index.size(), 0, seed);
+        } catch (...) {
+            task_pool = nullptr;
+            node_mutex = nullptr;
+            throw;
+        }
+        task_pool = nullptr;
+        node_mutex = nullptr;
+        vector<vector<pair<double, size_t>>>().swap(thread_scratch);
+    } else {
+        root = build(0, index.size(), 0, seed);
+    }
+
+    // Release the training buffers; only the nodes are kept
+    vector<double>().swap(train_X);
+    vector<int>().swap(train_y);
+    vector<uint8_t>().swap(train_bins);
+    binner = nullptr;
+    train_cols = nullptr;
+    train_labels = nullptr;
+    vector<size_t>().swap(index);
+    vector<pair<double, size_t>>().swap(scratch);
+    vector<int>().swap(all_features);
 }
 
-int DecisionTree::predict_one(const vector<double>& x, Node* node) {
+int DecisionTree::predict_one(const double* x, Node* node) {
     if (node->is_leaf)
         return node->predicted_class;
 
@@ -121,23 +460,371 @@ int DecisionTree::predict_one(const vector<double>& x, Node* node) {
 }
 
 int DecisionTree::predict(const vector<double>& x) {
-    return predict_one(x, root);
+    if (flat_nodes)
+        return predict_flat(x.data());
+    return predict_one(x.data(), root);
 }
-#include <fstream>
-#include <iostream>
 
-// Save entire tree
-void DecisionTree::save(const std::string& filename) {
-    std::ofstream out(filename);
-    if (!out) {
-        std::cerr << "Error: cannot open file for writing: " << filename << "\n";
+// ============ Compiled (flat) form ============
+
+// Breadth-first layout: siblings are adjacent, so an internal node only
+// needs the index of its left child, and the top levels that every sample
+// visits share the first few cache lines.
+// Thresholds are narrowed to float. A double feature lying between a
+// threshold and its float rounding can therefore route differently from
+// the pointer tree; features that are themselves float always agree.
+void DecisionTree::compile() {
+    if (!root) return;  // nothing to compile, or already loaded compiled
+    flat.clear();
+
+    vector<const Node*> order;  // order[i] becomes flat[i]
+    vector<int> depth;          // depth[i] of order[i]
+    order.reserve(pool.size());
+    depth.reserve(pool.size());
+    order.push_back(root);
+    depth.push_back(0);
+    flat.reserve(pool.size());
+    flat_depth = 0;
+
+    for (size_t i = 0; i < order.size(); i++) {
+        const Node* node = order[i];
+        FlatNode fn;
+
+        if (node->is_leaf) {
+            fn.threshold = 0.0f;
+            fn.feature = -1;
+            fn.child = (uint32_t)node->predicted_class;
+            flat_depth = max(flat_depth, depth[i]);
+        } else {
+            fn.threshold = (float)node->threshold;
+            fn.feature = node->feature_index;
+            fn.child = (uint32_t)order.size();
+            order.push_back(node->left);
+            order.push_back(node->right);
+            depth.push_back(depth[i] + 1);
+            depth.push_back(depth[i] + 1);
+        }
+
+        flat.push_back(fn);
+    }
+
+    flat_nodes = flat.data();
+    flat_size = flat.size();
+    mapped.close();
+}
+
+size_t DecisionTree::feature_span() const {
+    size_t span = 0;
+    for (size_t i = 0; i < flat_size; i++) {
+        if (flat_nodes[i].feature >= 0) span = max(span, (size_t)flat_nodes[i].feature + 1);
+    }
+    return span;
+}
+
+int DecisionTree::predict_flat(const double* x) const {
+    const FlatNode* nodes = flat_nodes;
+    uint32_t i = 0;
+
+    // A predicted branch lets the CPU start loading the next node before
+    // the compare resolves; a branch-free index update would serialize
+    // every level on the feature load and measures slower for one sample.
+    while (nodes[i].feature >= 0) {
+        const FlatNode& node = nodes[i];
+        if (x[node.feature] < node.threshold)
+            i = node.child;
+        else
+            i = node.child + 1;
+    }
+
+    return (int)nodes[i].child;
+}
+// ============ Batch prediction ============
+
+// Number of samples walked through the tree together. Their node and
+// feature loads are independent, so the CPU overlaps them instead of
+// waiting on one dependent chain at a time.
+static const int BATCH_LANES = 8;
+
+// Smallest slice worth handing to its own thread
+static const size_t BATCH_MIN_ROWS_PER_THREAD = 1024;
+
+// Walk rows [begin, end) of a row-major matrix through a flat tree,
+// BATCH_LANES at a time. Lanes that reached a leaf stay put until every
+// lane in the group has finished (at most flat_depth steps).
+// T is double for raw rows and uint8_t for bin indices (see compile_bins).
+template <typename T>
+static void predictFlatRange(const FlatNode* nodes, int flat_depth,
+                             const T* X, size_t cols,
+                             size_t begin, size_t end, int* out)
+{
+    size_t r = begin;
+    for (; r + BATCH_LANES <= end; r += BATCH_LANES) {
+        const T* rows[BATCH_LANES];
+        uint32_t idx[BATCH_LANES];
+        for (int s = 0; s < BATCH_LANES; s++) {
+            rows[s] = X + (r + s) * cols;
+            idx[s] = 0;
+        }
+
+        bool active = true;
+        for (int step = 0; step < flat_depth && active; step++) {
+            active = false;
+            for (int s = 0; s < BATCH_LANES; s++) {
+                const FlatNode& node = nodes[idx[s]];
+                if (node.feature < 0) continue;
+                idx[s] = node.child + !(rows[s][node.feature] < node.threshold);
+                active = true;
+            }
+        }
+
+        for (int s = 0; s < BATCH_LANES; s++)
+            out[r + s] = (int)nodes[idx[s]].child;
+    }
+
+    // Tail: fewer than BATCH_LANES rows left
+    for (; r < end; r++) {
+        const T* x = X + r * cols;
+        uint32_t i = 0;
+        while (nodes[i].feature >= 0)
+            i = nodes[i].child + !(x[nodes[i].feature] < nodes[i].threshold);
+        out[r] = (int)nodes[i].child;
+    }
+}
+
+// Run predictFlatRange over rows, split into contiguous slices across
+// threads when the batch is large enough
+template <typename T>
+static void predictFlatBatch(const FlatNode* nodes, int flat_depth,
+                             const T* X, size_t rows, size_t cols,
+                             int* out, int threads)
+{
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    size_t max_threads = max<size_t>(1, rows / BATCH_MIN_ROWS_PER_THREAD);
+    if ((size_t)threads > max_threads) threads = (int)max_threads;
+
+    if (threads == 1) {
+        predictFlatRange(nodes, flat_depth, X, cols, 0, rows, out);
         return;
     }
-    saveNode(out, root);
+
+    // Contiguous slices, one per thread; each writes only its own part of out
+    vector<thread> workers;
+    size_t chunk = (rows + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = t * chunk;
+        size_t end = min(rows, begin + chunk);
+        if (begin >= end) break;
+        workers.emplace_back(predictFlatRange<T>, nodes, flat_depth,
+                             X, cols, begin, end, out);
+    }
+    for (auto& w : workers) w.join();
+}
+
+void DecisionTree::predict_batch(const double* X, size_t rows, size_t cols,
+                                 int* out, int threads)
+{
+    if (rows == 0) return;
+
+    // Without a compiled form, fall back to the pointer tree per sample
+    if (!flat_nodes) {
+        for (size_t r = 0; r < rows; r++)
+            out[r] = predict_one(X + r * cols, root);
+        return;
+    }
+
+    predictFlatBatch(flat_nodes, flat_depth, X, rows, cols, out, threads);
+}
+
+void DecisionTree::predict_batch(const uint8_t* X, size_t rows, size_t cols,
+                                 int* out, int threads)
+{
+    if (rows == 0) return;
+    if (bin_flat.empty()) {
+        cerr << "Error: predict_batch on bins needs compile_bins() first\n";
+        fill(out, out + rows, 0);
+        return;
+    }
+    predictFlatBatch(bin_flat.data(), flat_depth, X, rows, cols, out, threads);
+}
+
+void DecisionTree::compile_bins(const FeatureBinner& bins) {
+    if (!flat_nodes) compile();
+    bin_flat.assign(flat_nodes, flat_nodes + flat_size);
+    for (FlatNode& node : bin_flat) {
+        if (node.feature < 0) continue;
+        // A feature the bins don't cover can never match; send it left
+        node.threshold = (size_t)node.feature < bins.size()
+                         ? (float)bins.split_bin(node.feature, node.threshold)
+                         : (float)FeatureBinner::MAX_BINS;
+    }
+}
+
+void DecisionTree::predict_batch(const vector<vector<double>>& X,
+                                 vector<int>& out, int threads)
+{
+    out.resize(X.size());
+    if (X.empty()) return;
+
+    // Rows of a vector<vector> are not contiguous; pack them once
+    size_t cols = X[0].size();
+    vector<double> packed(X.size() * cols);
+    for (size_t r = 0; r < X.size(); r++)
+        copy(X[r].begin(), X[r].end(), packed.begin() + r * cols);
+
+    predict_batch(packed.data(), X.size(), cols, out.data(), threads);
+}
+
+// ============ Binary model file ============
+
+// Payload of a MODEL_DECISION_TREE file: this header, then node_count
+// FlatNodes in the breadth-first order produced by compile().
+struct TreePayload {
+    uint32_t node_count;
+    int32_t depth;
+};
+
+int flatTreeDepth(const FlatNode* nodes, uint32_t begin, uint32_t end,
+                  const string& source)
+{
+    if (begin >= end) throw runtime_error("Error: empty tree: " + source);
+
+    // Parents come before their children, so one forward pass sees every
+    // reachable node's depth before the node itself (-1: not reached)
+    vector<int> depth(end - begin, -1);
+    depth[0] = 0;
+    int deepest = 0;
+    for (uint32_t i = begin; i < end; i++) {
+        const FlatNode& node = nodes[i];
+        if (node.feature < 0) {
+            if (node.feature != -1 || node.child > 1) {
+                throw runtime_error("Error: tree leaf is corrupt: " + source);
+            }
+        } else if (node.child <= i || (uint64_t)node.child + 1 >= end) {
+            throw runtime_error("Error: tree node links are corrupt: " + source);
+        }
+
+        int d = depth[i - begin];
+        if (d < 0) continue;
+        if (node.feature < 0) {
+            deepest = max(deepest, d);
+        } else {
+            depth[node.child - begin] = max(depth[node.child - begin], d + 1);
+            depth[node.child + 1 - begin] = max(depth[node.child + 1 - begin], d + 1);
+        }
+    }
+    return deepest;
+}
+
+bool DecisionTree::save(const string& filename) {
+    if (!flat_nodes) compile();
+    if (!flat_nodes) {
+        cerr << "Error: cannot save an untrained tree: " << filename << "\n";
+        return false;
+    }
+
+    TreePayload head = {(uint32_t)flat_size, flat_depth};
+    vector<unsigned char> payload(sizeof(head) + flat_size * sizeof(FlatNode));
+    memcpy(payload.data(), &head, sizeof(head));
+    memcpy(payload.data() + sizeof(head), flat_nodes, flat_size * sizeof(FlatNode));
+
+    try {
+        writeModelFile(filename, MODEL_DECISION_TREE, payload.data(), payload.size());
+    } catch (const std::exception& e) {
+        cerr << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Maps the file and predicts straight from it. Only the compiled form is
+// available afterwards (root stays null), which is all inference needs.
+bool DecisionTree::load(const string& filename) {
+    clear();
+
+    try {
+        size_t size;
+        const unsigned char* payload = openModelFile(mapped, filename,
+                                                     MODEL_DECISION_TREE, size);
+
+        TreePayload head;
+        if (size < sizeof(head)) {
+            throw runtime_error("Error: tree payload is truncated: " + filename);
+        }
+        memcpy(&head, payload, sizeof(head));
+        if (head.node_count == 0 ||
+            size != sizeof(head) + (size_t)head.node_count * sizeof(FlatNode)) {
+            throw runtime_error("Error: tree node count does not match file size: " + filename);
+        }
+
+        // Children always follow their parent in breadth-first order, which
+        // guarantees every walk ends at a leaf inside the array. The batch
+        // walk takes exactly `depth` steps, so the header must agree.
+        const FlatNode* nodes = (const FlatNode*)(payload + sizeof(head));
+        int depth = flatTreeDepth(nodes, 0, head.node_count, filename);
+        if (head.depth != depth) {
+            throw runtime_error("Error: tree depth does not match its nodes: " + filename);
+        }
+
+        flat_nodes = nodes;
+        flat_size = head.node_count;
+        flat_depth = depth;
+    } catch (const std::exception& e) {
+        cerr << e.what() << "\n";
+        clear();
+        return false;
+    }
+    return true;
+}
+
+// ============ Text export/import ============
+
+// One line per node in pre-order, "NULL" for a missing child. Thresholds
+// are written with max_digits10 so they read back bit-exact. A tree that
+// only has its compiled form (after load()) is written from the flat
+// nodes, with their float thresholds, in the same format.
+bool DecisionTree::export_text(const string& filename) {
+    if (!root && !flat_nodes) {
+        cerr << "Error: cannot export an empty tree: " << filename << "\n";
+        return false;
+    }
+    ofstream out(filename);
+    if (!out) {
+        cerr << "Error: cannot open file for writing: " << filename << "\n";
+        return false;
+    }
+    out << setprecision(numeric_limits<double>::max_digits10);
+    if (root) {
+        saveNode(out, root);
+    } else {
+        saveFlat(out);
+    }
+    if (!out) {
+        cerr << "Error: failed writing " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+// saveNode() over the compiled form: an explicit stack instead of
+// recursion, and each leaf followed by its two missing children
+void DecisionTree::saveFlat(ofstream& out) {
+    vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const FlatNode& node = flat_nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.feature < 0) {
+            out << "LEAF " << node.child << " -1 0\nNULL\nNULL\n";
+            continue;
+        }
+        out << "NODE -1 " << node.feature << " " << (double)node.threshold << "\n";
+        stack.push_back(node.child + 1);
+        stack.push_back(node.child);
+    }
 }
 
 // Recursive save
-void DecisionTree::saveNode(std::ofstream& out, Node* node) {
+void DecisionTree::saveNode(ofstream& out, Node* node) {
     if (!node) {
         out << "NULL\n";
         return;
@@ -152,38 +839,126 @@ void DecisionTree::saveNode(std::ofstream& out, Node* node) {
     saveNode(out, node->right);
 }
 
-
-
-// Load entire tree
-void DecisionTree::load(const std::string& filename) {
-    std::ifstream in(filename);
+bool DecisionTree::import_text(const string& filename) {
+    ifstream in(filename);
     if (!in) {
-        std::cerr << "Error: cannot open file for reading: " << filename << "\n";
-        return;
+        cerr << "Error: cannot open file for reading: " << filename << "\n";
+        return false;
     }
+    clear();
     root = loadNode(in);
+    return root != nullptr;
 }
 
-// Recursive load
-Node* DecisionTree::loadNode(std::ifstream& in) {
-    std::string type;
-    in >> type;
+// Iterative load: an explicit stack of child slots replaces recursion, so
+// file depth is not limited by the call stack. Every record, leaf or not,
+// is followed by its two children, matching saveNode().
+Node* DecisionTree::loadNode(ifstream& in) {
+    Node* top = nullptr;
+    vector<Node**> slots = {&top};
+    string type;
+
+    while (!slots.empty() && in >> type) {
+        Node** slot = slots.back();
+        slots.pop_back();
+
+        if (type == "NULL") {
+            *slot = nullptr;
+            continue;
+        }
+
+        Node* node = new_node();
+        in >> node->predicted_class
+           >> node->feature_index
+           >> node->threshold;
 
-    if (type == "NULL") {
-        return nullptr;
+        node->is_leaf = (type == "LEAF");
+        *slot = node;
+
+        slots.push_back(&node->right);
+        slots.push_back(&node->left);
     }
 
-    Node* node = new Node();
-    in >> node->predicted_class
-       >> node->feature_index
-       >> node->threshold;
+    return top;
+}
+
+// ============ C++ export ============
 
-    node->is_leaf = (type == "LEAF");
+// Each tree level nests one more brace; clang stops at 256 by default
+static const int CPP_MAX_DEPTH = 200;
 
-    if (!node->is_leaf) {
-        node->left = loadNode(in);
-        node->right = loadNode(in);
+// Exact literal of the double the flat walk compares against
+static string cppDouble(double v) {
+    if (std::isnan(v)) return "std::numeric_limits<double>::quiet_NaN()";
+    if (std::isinf(v))
+        return v > 0 ? "std::numeric_limits<double>::infinity()"
+                     : "-std::numeric_limits<double>::infinity()";
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%a", v);
+    return buf;
+}
+
+// Written depth-first from an explicit stack, like loadNode(), so a
+// corrupt depth in a loaded file cannot exhaust the call stack. The
+// compare is the one predict_flat() makes, `<` against the float
+// threshold widened to double, so both forms route every row alike.
+bool DecisionTree::export_cpp(const string& filename, const string& source) {
+    if (!flat_nodes) compile();
+    if (!flat_nodes) {
+        cerr << "Error: cannot export an untrained tree: " << filename << "\n";
+        return false;
+    }
+    ofstream out(filename);
+    if (!out) {
+        cerr << "Error: cannot open file for writing: " << filename << "\n";
+        return false;
     }
 
-    return node;
+    out << "// Generated from " << (source.empty() ? string("a DecisionTree") : source)
+        << " by DecisionTree::export_cpp; do not edit.\n"
+        << "#include \"compiled_tree.h\"\n"
+        << "#include <limits>\n\n"
+        << "const size_t compiled_tree_nodes = " << flat_size << ";\n"
+        << "const int compiled_tree_depth = " << flat_depth << ";\n"
+        << "const size_t compiled_tree_feature_span = " << feature_span() << ";\n\n"
+        << "static inline int predict_row(const double* x)\n{\n";
+
+    enum Step { NODE, ELSE, CLOSE };
+    struct Item { Step step; uint32_t node; int level; };
+    vector<Item> stack = {{NODE, 0, 1}};
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        string indent(4 * item.level, ' ');
+        if (item.step == ELSE) { out << indent << "} else {\n"; continue; }
+        if (item.step == CLOSE) { out << indent << "}\n"; continue; }
+
+        const FlatNode& node = flat_nodes[item.node];
+        if (node.feature < 0) {
+            out << indent << "return " << (int)node.child << ";\n";
+            continue;
+        }
+        if (item.level > CPP_MAX_DEPTH) {
+            cerr << "Error: tree is too deep to export as C++ (limit " << CPP_MAX_DEPTH
+                 << " levels): " << filename << "\n";
+            return false;
+        }
+        out << indent << "if (x[" << node.feature << "] < "
+            << cppDouble((double)node.threshold) << ") {\n";
+        stack.push_back({CLOSE, 0, item.level});
+        stack.push_back({NODE, node.child + 1, item.level + 1});
+        stack.push_back({ELSE, 0, item.level});
+        stack.push_back({NODE, node.child, item.level + 1});
+    }
+
+    out << "}\n\n"
+        << "int compiled_tree_predict(const double* x)\n{\n"
+        << "    return predict_row(x);\n}\n\n"
+        << "void compiled_tree_predict_batch(const double* X, size_t rows, size_t cols, int* out)\n{\n"
+        << "    for (size_t r = 0; r < rows; r++) out[r] = predict_row(X + r * cols);\n}\n";
+    if (!out) {
+        cerr << "Error: failed writing " << filename << "\n";
+        return false;
+    }
+    return true;
 }
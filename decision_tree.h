@@ -3,6 +3,15 @@
 
 #include <vector>
 #include <string>
+#include <deque>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include "model_file.h"
+#include "task_pool.h"
+#include "feature_bins.h"
 
 struct Node {
     bool is_leaf;
@@ -17,35 +26,193 @@ struct Node {
     Node();
 };
 
+// Compact node of the compiled (flattened) tree, 12 bytes.
+// Internal nodes: feature >= 0 and the children sit at child and child+1.
+// Leaves: feature == -1 and child holds the predicted class.
+struct FlatNode {
+    float threshold;
+    int32_t feature;
+    uint32_t child;
+};
+
+// Checks that nodes[begin, end) hold one compiled tree rooted at `begin`:
+// every internal node's children lie after it and inside the range, and
+// every leaf has feature -1 and class 0 or 1, so any walk from the root
+// ends at a leaf of this tree. Child indices are absolute (into `nodes`).
+// Returns the depth of the deepest leaf reachable from the root; throws
+// std::runtime_error naming `source` if the nodes are corrupt.
+int flatTreeDepth(const FlatNode* nodes, uint32_t begin, uint32_t end,
+                  const std::string& source);
+
 class DecisionTree {
 public:
     Node* root;
     int max_depth;
     int min_samples;
 
+    // Features searched per split: 0 searches all of them, otherwise each
+    // node draws its own random subset of this size from `seed` (and its
+    // position in the tree), so results never depend on thread timing
+    int max_features = 0;
+    uint64_t seed = 0;
+
     DecisionTree(int depth = 5, int min_s = 2);
 
+    // Nodes are owned by the tree's pool, so copies would alias them
+    DecisionTree(const DecisionTree&) = delete;
+    DecisionTree& operator=(const DecisionTree&) = delete;
+    DecisionTree(DecisionTree&&) = default;
+    DecisionTree& operator=(DecisionTree&&) = default;
+
+    // threads > 1 (or <= 0 for one per core) builds on a TaskPool: large
+    // nodes near the root search blocks of features in parallel, and
+    // deeper down the left and right subtrees become separate tasks. The
+    // tree is identical for any thread count.
     void train(const std::vector<std::vector<double>>& X,
-               const std::vector<int>& y);
+               const std::vector<int>& y, int threads = 1);
+
+    // Train on quantized features (see feature_bins.h). Splits are found
+    // from per-node bin histograms instead of sorting, and each node's
+    // threshold is the raw edge its bin split maps to, so the tree also
+    // predicts raw rows exactly as on bins. Ties go to the lowest feature,
+    // then the lowest bin. The bin form is compiled as well, ready for the
+    // uint8_t predict_batch.
+    void train_binned(const BinnedMatrix& X, const std::vector<int>& y,
+                      const FeatureBinner& bins, int threads = 1);
 
+    // Train on a column-major n_features x n_samples matrix the caller
+    // keeps alive for the call (nothing is copied), using only the rows
+    // listed in `samples`; a row listed k times counts k times, as in a
+    // bootstrap sample. Lets several trees share one copy of the data.
+    void train_columns(const double* columns, const int* y,
+                       size_t n_samples, size_t n_features,
+                       std::vector<size_t> samples, int threads = 1);
+
+    // Uses the compiled form when present, otherwise walks the nodes
     int predict(const std::vector<double>& x);
 
-    // --- NEW ---
-    void save(const std::string& filename);
-    void load(const std::string& filename);
+    // Lay the tree out as a breadth-first FlatNode array for inference.
+    // Call after train() or import_text(), which discard any previous
+    // compiled form; load() yields the compiled form directly.
+    void compile();
+    bool compiled() const { return flat_nodes != nullptr; }
+
+    // The compiled node array (null if not compiled) and its depth
+    const FlatNode* compiled_nodes() const { return flat_nodes; }
+    size_t compiled_size() const { return flat_size; }
+    int compiled_depth() const { return flat_depth; }
+
+    // Smallest row width the compiled tree can be applied to (one past the
+    // highest feature index it splits on); 0 if not compiled
+    size_t feature_span() const;
+
+    // Predict every row of a row-major rows x cols matrix into out[0, rows).
+    // Samples are walked through the compiled tree several at a time, and
+    // threads > 1 (or <= 0 for one per core) splits large batches across
+    // threads. Labels are identical to calling predict() on each row.
+    void predict_batch(const double* X, size_t rows, size_t cols,
+                       int* out, int threads = 1);
+    void predict_batch(const std::vector<std::vector<double>>& X,
+                       std::vector<int>& out, int threads = 1);
+
+    // Compiled form over bin indices: every threshold mapped to the split
+    // bin < b (exact for trees trained on these bins). Compiles the raw
+    // form first if needed; works after load() too.
+    void compile_bins(const FeatureBinner& bins);
+    bool bins_compiled() const { return !bin_flat.empty(); }
+
+    // predict_batch over rows of bin indices; requires compile_bins()
+    void predict_batch(const uint8_t* X, size_t rows, size_t cols,
+                       int* out, int threads = 1);
+
+    // Binary model file (see model_file.h): the compiled node array behind
+    // a checksummed header. save() compiles first if needed; load() maps
+    // the file and predicts from it in place. Both print and return false
+    // on failure.
+    bool save(const std::string& filename);
+    bool load(const std::string& filename);
+
+    // Text format, one line per node; kept for inspection and old files.
+    // Exporting a loaded tree writes its compiled (float) thresholds.
+    bool export_text(const std::string& filename);
+    bool import_text(const std::string& filename);
+
+    // C++ source defining the functions in compiled_tree.h for this tree:
+    // its compiled form (compiled first if needed) as nested if/else with
+    // the thresholds as exact literals. `source` names the model in the
+    // generated header comment. Prints and returns false on failure.
+    bool export_cpp(const std::string& filename, const std::string& source = "");
+
+    // Free every node and the compiled form; train(), load() and
+    // import_text() call this first
+    void clear();
 
 private:
-    double gini(const std::vector<int>& labels);
-    int most_common(const std::vector<int>& labels);
+    // Node arena, released as a whole
+    std::deque<Node> pool;
+    Node* new_node();
+
+    // Compiled inference form. flat_nodes points into `flat` after
+    // compile(), or into `mapped` after load().
+    std::vector<FlatNode> flat;
+    MappedFile mapped;
+    const FlatNode* flat_nodes = nullptr;
+    size_t flat_size = 0;
+    int flat_depth = 0;
+    std::vector<FlatNode> bin_flat;     // same layout, thresholds are bin indices
+
+    // Training state, only populated during train()
+    std::vector<double> train_X;    // column-major copy made by train()
+    std::vector<int> train_y;
+    const double* train_cols = nullptr;   // n_features x n_samples, train_X or the caller's
+    const int* train_labels = nullptr;
+    std::vector<uint8_t> train_bins;      // column-major bin indices, train_binned() only
+    const FeatureBinner* binner = nullptr;
+    std::vector<size_t> index;      // sample ids in training, partitioned per node
+    std::vector<std::pair<double, size_t>> scratch;   // one slot per index entry, split by node
+    std::vector<int> all_features;  // 0 .. n_features-1
+    size_t n_samples = 0;
+    size_t n_features = 0;
+
+    // Parallel training state, set only while train() runs with threads > 1
+    TaskPool* task_pool = nullptr;
+    std::mutex* node_mutex = nullptr;
+    std::vector<std::vector<std::pair<double, size_t>>> thread_scratch;  // per pool thread
+
+    // Best split found over some range of features
+    struct SplitCandidate {
+        double gini = std::numeric_limits<double>::infinity();
+        int feature = -1;
+        double threshold = 0.0;
+    };
+
+    double gini(size_t count0, size_t count1);
+    int most_common(size_t count0, size_t count1);
+    void count_labels(size_t begin, size_t end, size_t& count0, size_t& count1);
+
+    void scan_bins(size_t begin, size_t end,
+                   const int* features, size_t feature_count,
+                   size_t total0, size_t total1,
+                   SplitCandidate& best);
+
+    void scan_features(size_t begin, size_t end,
+                       const int* features, size_t feature_count,
+                       size_t total0, size_t total1,
+                       std::pair<double, size_t>* sorted,
+                       SplitCandidate& best);
+
+    bool best_split(size_t begin, size_t end, int depth, uint64_t node_seed,
+                    int& best_feature,
+                    double& best_threshold);
 
-    Node* build(const std::vector<std::vector<double>>& X,
-                const std::vector<int>& y,
-                int depth);
+    void fit(int threads);
+    Node* build(size_t begin, size_t end, int depth, uint64_t node_seed);
 
-    int predict_one(const std::vector<double>& x, Node* node);
+    int predict_one(const double* x, Node* node);
+    int predict_flat(const double* x) const;
 
-    // --- NEW ---
     void saveNode(std::ofstream& out, Node* node);
+    void saveFlat(std::ofstream& out);
     Node* loadNode(std::ifstream& in);
 };
 
@@ -0,0 +1,263 @@
+#include "enhance.h"
+#include "bounded_queue.h"
+#include "task_pool.h"
+#include "profiler.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using namespace std;
+
+EnhanceFilter parseEnhanceFilter(const string& name)
+{
+    if (name == "sharpen") return EnhanceFilter::SHARPEN;
+    if (name == "clahe") return EnhanceFilter::CLAHE;
+    if (name == "unsharp") return EnhanceFilter::UNSHARP;
+    throw runtime_error("Unknown filter: " + name + " (expected sharpen, clahe or unsharp)");
+}
+
+// ============ Filters ============
+
+// Gaussian kernel size OpenCV picks for an 8-bit image when given only
+// sigma; passing it explicitly also fixes the halo a band needs
+static int gaussianKernelSize(double sigma) {
+    return cvRound(sigma * 3 * 2 + 1) | 1;
+}
+
+// Rows [y0, y1) of out. The filter runs on those rows plus a halo of
+// kernel-radius rows on each side (clamped to the image) as an isolated
+// image, so rows inside the band see exactly the neighbours a
+// whole-image pass gives them, and only the image's own top and bottom
+// edges are extrapolated. No result depends on how OpenCV treats the
+// pixels around a view.
+static void filterBand(const cv::Mat& gray, cv::Mat& out, const EnhanceOptions& options,
+                       int y0, int y1)
+{
+    const int border = cv::BORDER_DEFAULT | cv::BORDER_ISOLATED;
+    bool sharpen = options.filter == EnhanceFilter::SHARPEN;
+    int ksize = sharpen ? 3 : gaussianKernelSize(options.unsharp_sigma);
+    int h0 = max(0, y0 - ksize / 2), h1 = min(gray.rows, y1 + ksize / 2);
+
+    cv::Mat src = gray.rowRange(h0, h1);
+    cv::Mat dst = out.rowRange(y0, y1);
+    thread_local cv::Mat filtered;  // band-plus-halo scratch, reused
+    if (sharpen) {
+        static const cv::Mat kernel = (cv::Mat_<float>(3,3) << -1, -1, -1,
+                                                               -1,  9, -1,
+                                                               -1, -1, -1);
+        if (h0 == y0 && h1 == y1) {     // the whole image: no halo to drop
+            cv::filter2D(src, dst, CV_8U, kernel, cv::Point(-1, -1), 0, border);
+            return;
+        }
+        cv::filter2D(src, filtered, CV_8U, kernel, cv::Point(-1, -1), 0, border);
+        filtered.rowRange(y0 - h0, y1 - h0).copyTo(dst);
+    } else {
+        cv::GaussianBlur(src, filtered, cv::Size(ksize, ksize), options.unsharp_sigma, 0, border);
+        cv::addWeighted(gray.rowRange(y0, y1), 1.0 + options.unsharp_amount,
+                        filtered.rowRange(y0 - h0, y1 - h0), -options.unsharp_amount, 0.0, dst);
+    }
+}
+
+void enhanceImage(const cv::Mat& gray, cv::Mat& out, const EnhanceOptions& options, TaskPool* pool)
+{
+    if (gray.empty() || gray.type() != CV_8UC1) {
+        throw runtime_error("Error: enhancement needs an 8-bit grayscale image");
+    }
+    if (options.filter == EnhanceFilter::CLAHE) {
+        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(options.clahe_clip,
+                                                   cv::Size(options.clahe_grid, options.clahe_grid));
+        clahe->apply(gray, out);
+        return;
+    }
+
+    // Bands write into out while their neighbours still read gray
+    cv::Mat src = (out.data == gray.data) ? gray.clone() : gray;
+    out.create(src.rows, src.cols, CV_8UC1);
+
+    int band = options.tile_rows;
+    if (!pool || band <= 0 || src.rows < 2 * band) {
+        filterBand(src, out, options, 0, src.rows);
+        return;
+    }
+    TaskPool::Group bands;
+    for (int y = 0; y < src.rows; y += band) {
+        pool->run(bands, [&, y] { filterBand(src, out, options, y, min(src.rows, y + band)); });
+    }
+    pool->wait(bands);
+}
+
+// ============ Directory pipeline ============
+
+struct EnhancedImage {
+    size_t index;
+    cv::Mat image;
+};
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Adds the time since `start` to a stage's thread-seconds total
+static void addTime(atomic<uint64_t>& total_ns, chrono::steady_clock::time_point start) {
+    total_ns += (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - start).count();
+}
+
+bool enhanceDirectory(const string& input_dir, const string& output_dir,
+                      const EnhanceOptions& options, EnhanceStats& stats, ostream& log)
+{
+    if (!fs::exists(input_dir) || !fs::is_directory(input_dir)) {
+        std::cerr << "Error: Directory '" << input_dir << "' does not exist or is not a directory." << std::endl;
+        return false;
+    }
+    fs::create_directories(output_dir);
+
+    int threads = options.threads > 0 ? options.threads : (int)max(1u, thread::hardware_concurrency());
+    int writers = max(1, options.writers);
+
+    // Every listed image holds a slot from decode until its file is
+    // written, which bounds the images in memory whatever stage lags
+    size_t slot_count = 2 * (size_t)threads + writers;
+    BoundedQueue<char> slots(slot_count);
+    for (size_t i = 0; i < slot_count; i++) slots.push(0);
+    BoundedQueue<EnhancedImage> to_write(slot_count);
+
+    atomic<size_t> images{0}, written_bytes{0};
+    atomic<uint64_t> pixels{0};
+    atomic<uint64_t> decode_ns{0}, filter_ns{0}, encode_ns{0}, write_ns{0};
+
+    mutex error_mutex;
+    exception_ptr error;
+    auto fail = [&](exception_ptr e) {
+        {
+            lock_guard<mutex> lock(error_mutex);
+            if (!error) error = e;
+        }
+        slots.close();
+        to_write.close();
+    };
+
+    auto start = chrono::steady_clock::now();
+
+    // ---- Stage 3: encode + write ----
+    vector<thread> writer_threads;
+    for (int t = 0; t < writers; t++) {
+        writer_threads.emplace_back([&] {
+            EnhancedImage item;
+            vector<uchar> png;  // encoded bytes, reused across images
+            while (to_write.pop(item)) {
+                try {
+                    auto t0 = chrono::steady_clock::now();
+                    {
+                        PROFILE_SCOPE("encode");
+                        if (!cv::imencode(".png", item.image, png)) {
+                            throw runtime_error("Error: could not encode image " + to_string(item.index));
+                        }
+                    }
+                    auto t1 = chrono::steady_clock::now();
+                    addTime(encode_ns, t0);
+
+                    string path = (fs::path(output_dir) / (to_string(item.index) + ".png")).string();
+                    {
+                        PROFILE_SCOPE("write");
+                        ofstream out(path, ios::binary);
+                        if (!out.write((const char*)png.data(), png.size())) {
+                            throw runtime_error("Error: could not write " + path);
+                        }
+                    }
+                    addTime(write_ns, t1);
+                    written_bytes += png.size();
+                    item.image.release();
+                    slots.push(0);
+                } catch (...) {
+                    fail(current_exception());
+                    break;
+                }
+            }
+        });
+    }
+
+    // ---- Stage 2: decode + filter, one task per image ----
+    // One participant more than `threads`: this thread lists and mostly
+    // waits for slots, so it must not be the only one running tasks
+    TaskPool::Group filter_tasks;
+    {
+        TaskPool pool(threads + 1);
+        auto filterOne = [&](size_t index, const string& path) {
+            try {
+                auto t0 = chrono::steady_clock::now();
+                cv::Mat gray;
+                {
+                    PROFILE_SCOPE("decode");
+                    gray = cv::imread(path, cv::IMREAD_GRAYSCALE);
+                }
+                if (gray.empty()) throw runtime_error("Error: Could not open or find the image: " + path);
+                auto t1 = chrono::steady_clock::now();
+                addTime(decode_ns, t0);
+
+                EnhancedImage item{index, cv::Mat()};
+                {
+                    PROFILE_SCOPE("enhance");
+                    enhanceImage(gray, item.image, options, &pool);
+                }
+                addTime(filter_ns, t1);
+                pixels += (uint64_t)gray.rows * gray.cols;
+                images++;
+                PROFILE_COUNT("images", 1);
+                to_write.push(std::move(item));
+            } catch (...) {
+                fail(current_exception());
+            }
+        };
+
+        // ---- Stage 1: list ----
+        try {
+            size_t index = 0;
+            char slot;
+            for (const auto& entry : fs::directory_iterator(input_dir)) {
+                if (!fs::is_regular_file(entry.status())) continue;
+                if (!slots.pop(slot)) break;
+                string path = entry.path().string();
+                pool.run(filter_tasks, [&, index, path] { filterOne(index, path); });
+                index++;
+                if (index % 200 == 0) {
+                    log << "  listed " << index << ", filtered " << images << " ("
+                        << fixed << setprecision(1) << pixels / 1e6 / secondsSince(start)
+                        << " MP/s)" << endl;
+                }
+            }
+        } catch (...) {
+            fail(current_exception());
+        }
+        pool.wait(filter_tasks);
+    }
+    to_write.close();
+    for (auto& w : writer_threads) w.join();
+    if (error) rethrow_exception(error);
+
+    stats.images = images;
+    stats.megapixels = pixels / 1e6;
+    stats.seconds = secondsSince(start);
+    stats.bytes_written = written_bytes;
+
+    // Stage times are summed over threads, so they show where the work
+    // went; the wall time shows how well it overlapped
+    double mp_per_s = stats.seconds > 0 ? stats.megapixels / stats.seconds : 0.0;
+    log << fixed << setprecision(2)
+        << "  decode:  " << decode_ns / 1e9 << " s   filter: " << filter_ns / 1e9
+        << " s   encode: " << encode_ns / 1e9 << " s   write: " << write_ns / 1e9
+        << " s  (thread time; " << threads << " filter threads, " << writers << " writers)" << endl
+        << "  " << stats.images << " images, " << stats.megapixels << " MP in " << stats.seconds
+        << " s: " << mp_per_s << " MP/s, " << (stats.seconds > 0 ? stats.images / stats.seconds : 0.0)
+        << " images/s, " << written_bytes / (1024.0 * 1024.0) << " MB written" << endl;
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef ENHANCE_H
+#define ENHANCE_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <ostream>
+#include <iostream>
+#include <cstddef>
+
+class TaskPool;
+
+enum class EnhanceFilter {
+    SHARPEN,    // 3x3 Laplacian sharpening kernel (center 9, neighbours -1)
+    CLAHE,      // contrast-limited adaptive histogram equalization
+    UNSHARP     // image + amount * (image - Gaussian blur)
+};
+
+// Parses "sharpen", "clahe" or "unsharp"; throws std::runtime_error otherwise
+EnhanceFilter parseEnhanceFilter(const std::string& name);
+
+struct EnhanceOptions {
+    EnhanceFilter filter = EnhanceFilter::SHARPEN;
+    double unsharp_sigma = 2.0;
+    double unsharp_amount = 1.0;
+    double clahe_clip = 2.0;
+    int clahe_grid = 8;         // tiles per side
+
+    int threads = 0;            // decode + filter workers, <= 0: one per core
+    int writers = 2;            // PNG encode + write threads
+    // Images taller than two tiles are filtered as bands of this many rows
+    // in parallel; 0 filters every image whole
+    int tile_rows = 256;
+};
+
+struct EnhanceStats {
+    size_t images = 0;
+    double megapixels = 0;
+    double seconds = 0;         // wall time, listing to last file written
+    size_t bytes_written = 0;
+};
+
+// Filter one 8-bit grayscale image into out. With a pool and tiling on,
+// SHARPEN and UNSHARP run as horizontal bands in parallel; each band is
+// filtered with a halo of its neighbours' rows as deep as the kernel's
+// radius, so the result is identical to filtering the image whole. CLAHE
+// interpolates between its tiles across the whole image and always runs
+// untiled.
+void enhanceImage(const cv::Mat& gray, cv::Mat& out, const EnhanceOptions& options,
+                  TaskPool* pool = nullptr);
+
+// Decode, filter and write every regular file in input_dir as a pipeline:
+//   list    - one thread queues (index, path) jobs in listing order
+//   filter  - `threads` workers decode to grayscale and run enhanceImage,
+//             sharing a TaskPool for the bands of large images
+//   write   - `writers` threads PNG-encode each result and write it to
+//             output_dir/<index>.png
+// Bounded queues between the stages keep at most a few images per worker
+// in memory, and encoding and disk writes overlap with filtering. Prints
+// per-stage times and megapixels per second to `log`. An image that fails
+// to decode or write stops the pipeline and is rethrown here.
+//
+// Returns false (after printing an error) if input_dir does not exist.
+bool enhanceDirectory(const std::string& input_dir, const std::string& output_dir,
+                      const EnhanceOptions& options, EnhanceStats& stats,
+                      std::ostream& log = std::cout);
+
+#endif
@@ -0,0 +1,105 @@
+#include "evaluation.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+using namespace std;
+
+int labelFromName(const string& name) {
+    if (name.find("Tuberculosis") != string::npos) return 1;
+    if (name.find("Normal") != string::npos) return 0;
+    return -1;
+}
+
+SweepResult sweepThresholds(const vector<double>& scores, const vector<int>& labels) {
+    SweepResult result;
+    size_t n = scores.size();
+    if (n == 0) return result;
+
+    vector<pair<double, int>> sorted(n);
+    for (size_t i = 0; i < n; i++) sorted[i] = {scores[i], labels[i]};
+    sort(sorted.begin(), sorted.end());
+
+    // Lowest cutoff: everything is predicted Tuberculosis
+    ThresholdPoint point;
+    point.threshold = sorted[0].first - 1.0;
+    for (const auto& s : sorted) {
+        if (s.second == 1) point.tp++;
+        else if (s.second == 0) point.fp++;
+    }
+
+    result.best.accuracy = -1;
+    size_t k = 0;
+    while (true) {
+        point.accuracy = (double)(point.tp + point.tn) / n;
+        result.curve.push_back(point);
+        if (point.accuracy > result.best.accuracy) result.best = point;
+        if (k == n) break;
+
+        // Move the run of samples equal to sorted[k] to the Normal side
+        double value = sorted[k].first;
+        for (; k < n && sorted[k].first == value; k++) {
+            if (sorted[k].second == 1) { point.tp--; point.fn++; }
+            else if (sorted[k].second == 0) { point.fp--; point.tn++; }
+        }
+
+        if (k == n) {
+            point.threshold = value + 1.0;
+        } else {
+            // Midpoint, unless rounding lands it on the next score
+            double mid = value + (sorted[k].first - value) / 2;
+            point.threshold = (mid < sorted[k].first) ? mid : value;
+        }
+    }
+
+    // Curve points run from "all TB" to "all Normal"; walk them backwards so
+    // recall and FPR increase
+    int positives = result.curve[0].tp + result.curve[0].fn;
+    int negatives = result.curve[0].fp + result.curve[0].tn;
+    double prev_tpr = 0, prev_fpr = 0, prev_recall = 0;
+    for (size_t i = result.curve.size(); i-- > 0;) {
+        const ThresholdPoint& p = result.curve[i];
+        double tpr = positives ? (double)p.tp / positives : 0;
+        double fpr = negatives ? (double)p.fp / negatives : 0;
+        result.roc_auc += (fpr - prev_fpr) * (tpr + prev_tpr) / 2;
+        if (p.tp + p.fp > 0) {
+            double precision = (double)p.tp / (p.tp + p.fp);
+            result.average_precision += (tpr - prev_recall) * precision;
+        }
+        prev_tpr = tpr;
+        prev_fpr = fpr;
+        prev_recall = tpr;
+    }
+
+    return result;
+}
+
+void writeCurves(const SweepResult& result, const string& curve_filename,
+                 const string& auc_filename)
+{
+    ofstream curve(curve_filename);
+    if (!curve) {
+        throw runtime_error("Error: cannot open file for writing: " + curve_filename);
+    }
+    curve << setprecision(numeric_limits<double>::max_digits10);
+    curve << "threshold,tp,fp,tn,fn,tpr,fpr,precision,recall,accuracy\n";
+
+    for (const ThresholdPoint& p : result.curve) {
+        int positives = p.tp + p.fn, negatives = p.fp + p.tn;
+        double tpr = positives ? (double)p.tp / positives : 0;
+        double fpr = negatives ? (double)p.fp / negatives : 0;
+        double precision = (p.tp + p.fp) ? (double)p.tp / (p.tp + p.fp) : 1;
+        curve << p.threshold << "," << p.tp << "," << p.fp << "," << p.tn << "," << p.fn << ","
+              << tpr << "," << fpr << "," << precision << "," << tpr << "," << p.accuracy << "\n";
+    }
+
+    ofstream auc(auc_filename);
+    if (!auc) {
+        throw runtime_error("Error: cannot open file for writing: " + auc_filename);
+    }
+    auc << setprecision(6) << fixed
+        << "roc_auc " << result.roc_auc << "\n"
+        << "average_precision " << result.average_precision << "\n";
+}
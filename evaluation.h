@@ -0,0 +1,40 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <string>
+#include <vector>
+
+// Ground truth from an image's file name, as image_processor has always
+// read it: 1 for "Tuberculosis", 0 for "Normal", -1 when neither appears
+int labelFromName(const std::string& name);
+
+// Confusion counts for "score > threshold means Tuberculosis".
+// Unlabelled images are in no cell but still count towards accuracy's
+// denominator, as before.
+struct ThresholdPoint {
+    double threshold = 0;
+    int tp = 0, fp = 0, tn = 0, fn = 0;
+    double accuracy = 0;
+};
+
+struct SweepResult {
+    ThresholdPoint best;                // highest accuracy, lowest threshold on ties
+    std::vector<ThresholdPoint> curve;  // every distinct cutoff, ascending
+    double roc_auc = 0;                 // trapezoidal area under the ROC curve
+    double average_precision = 0;       // area under the PR curve (step-wise)
+};
+
+// Sort the scores once and sweep every cutoff between consecutive distinct
+// scores, updating the confusion counts incrementally: O(N log N) overall,
+// with no fixed grid or range. Thresholds are midpoints between neighbours,
+// plus one below the lowest and one above the highest score.
+SweepResult sweepThresholds(const std::vector<double>& scores,
+                            const std::vector<int>& labels);
+
+// CSV with one row per curve point (threshold, counts, TPR, FPR,
+// precision, recall), and a small text file with the two areas.
+// Throws std::runtime_error if a file cannot be written.
+void writeCurves(const SweepResult& result, const std::string& curve_filename,
+                 const std::string& auc_filename);
+
+#endif
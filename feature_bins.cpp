@@ -0,0 +1,175 @@
+#include "feature_bins.h"
+#include "model_file.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// ============ Fitting ============
+
+// values is consumed (sorted in place)
+void FeatureBinner::fit_feature(vector<double>& values, int max_bins, vector<double>& out)
+{
+    out.clear();
+    if (values.empty()) return;
+    sort(values.begin(), values.end());
+
+    vector<double> distinct(values);
+    distinct.erase(unique(distinct.begin(), distinct.end()), distinct.end());
+
+    if ((int)distinct.size() <= max_bins) {
+        // One bin per value: every value but the smallest starts a bin
+        out.assign(distinct.begin() + 1, distinct.end());
+        return;
+    }
+
+    // Quantile edges, each a value from the data, so bins hold roughly
+    // equal numbers of training samples
+    size_t n = values.size();
+    for (int b = 1; b < max_bins; b++) {
+        double e = values[n * b / max_bins];
+        if (e > values[0] && (out.empty() || e > out.back())) out.push_back(e);
+    }
+}
+
+void FeatureBinner::fit(const vector<vector<double>>& X, int max_bins)
+{
+    max_bins = max(2, min(max_bins, MAX_BINS));
+    size_t cols = X.empty() ? 0 : X[0].size();
+    edges.assign(cols, vector<double>());
+
+    vector<double> values(X.size());
+    for (size_t f = 0; f < cols; f++) {
+        for (size_t i = 0; i < X.size(); i++) values[i] = X[i][f];
+        fit_feature(values, max_bins, edges[f]);
+    }
+}
+
+void FeatureBinner::fit(const FeatureMatrix& X, int max_bins)
+{
+    max_bins = max(2, min(max_bins, MAX_BINS));
+    edges.assign(X.cols, vector<double>());
+
+    vector<double> values(X.rows);
+    for (size_t f = 0; f < X.cols; f++) {
+        for (size_t i = 0; i < X.rows; i++) values[i] = X.row(i)[f];
+        fit_feature(values, max_bins, edges[f]);
+    }
+}
+
+// ============ Mapping ============
+
+uint8_t FeatureBinner::bin(size_t f, double x) const
+{
+    const vector<double>& e = edges[f];
+    return (uint8_t)(upper_bound(e.begin(), e.end(), x) - e.begin());
+}
+
+int FeatureBinner::split_bin(size_t f, double threshold) const
+{
+    const vector<double>& e = edges[f];
+    auto it = lower_bound(e.begin(), e.end(), threshold);
+    int below = (int)(it - e.begin());
+    if (it != e.end() && *it == threshold) return below + 1;
+
+    // Compiled trees keep float thresholds; accept an edge that rounds to
+    // it (an edge below the threshold already counts in `below`)
+    if (it != e.end() && (float)*it == (float)threshold) return below + 1;
+    return below;
+}
+
+void FeatureBinner::transform(const vector<vector<double>>& X, BinnedMatrix& out) const
+{
+    out.resize(X.size(), edges.size());
+    for (size_t i = 0; i < X.size(); i++) {
+        uint8_t* row = out.row(i);
+        for (size_t f = 0; f < edges.size(); f++) row[f] = bin(f, X[i][f]);
+    }
+}
+
+void FeatureBinner::transform(const FeatureMatrix& X, BinnedMatrix& out) const
+{
+    out.resize(X.rows, edges.size());
+    for (size_t i = 0; i < X.rows; i++) transform_row(X.row(i), out.row(i));
+}
+
+void FeatureBinner::transform_row(const feature_t* x, uint8_t* out) const
+{
+    for (size_t f = 0; f < edges.size(); f++) out[f] = bin(f, x[f]);
+}
+
+// ============ Binary model file ============
+
+// Payload of a MODEL_FEATURE_BINS file: this header, num_features + 1
+// cumulative edge offsets (uint64), then all edges as doubles, feature by
+// feature. Everything after the header is 8-byte aligned.
+struct BinsPayload {
+    uint64_t num_features;
+};
+
+void FeatureBinner::save(const string& filename) const
+{
+    size_t total = 0;
+    for (const auto& e : edges) total += e.size();
+
+    BinsPayload head = {edges.size()};
+    vector<unsigned char> payload(sizeof(head) + (edges.size() + 1) * sizeof(uint64_t) +
+                                  total * sizeof(double));
+    unsigned char* p = payload.data();
+    memcpy(p, &head, sizeof(head));
+    p += sizeof(head);
+
+    uint64_t offset = 0;
+    for (size_t f = 0; f <= edges.size(); f++) {
+        memcpy(p, &offset, sizeof(offset));
+        p += sizeof(offset);
+        if (f < edges.size()) offset += edges[f].size();
+    }
+    for (const auto& e : edges) {
+        memcpy(p, e.data(), e.size() * sizeof(double));
+        p += e.size() * sizeof(double);
+    }
+
+    writeModelFile(filename, MODEL_FEATURE_BINS, payload.data(), payload.size());
+}
+
+void FeatureBinner::load(const string& filename)
+{
+    MappedFile mapped;
+    size_t size;
+    const unsigned char* payload = openModelFile(mapped, filename, MODEL_FEATURE_BINS, size);
+
+    BinsPayload head;
+    if (size < sizeof(head)) {
+        throw runtime_error("Error: feature bins payload is truncated: " + filename);
+    }
+    memcpy(&head, payload, sizeof(head));
+    size_t offsets_size = (head.num_features + 1) * sizeof(uint64_t);
+    if (head.num_features > size || size < sizeof(head) + offsets_size) {
+        throw runtime_error("Error: feature bins payload is truncated: " + filename);
+    }
+
+    vector<uint64_t> offsets(head.num_features + 1);
+    memcpy(offsets.data(), payload + sizeof(head), offsets_size);
+    const unsigned char* values = payload + sizeof(head) + offsets_size;
+    if (offsets[0] != 0 || offsets.back() > size ||
+        size != sizeof(head) + offsets_size + offsets.back() * sizeof(double)) {
+        throw runtime_error("Error: feature bins size does not match its offsets: " + filename);
+    }
+
+    vector<vector<double>> loaded(head.num_features);
+    for (size_t f = 0; f < head.num_features; f++) {
+        if (offsets[f + 1] < offsets[f] || offsets[f + 1] - offsets[f] >= (uint64_t)MAX_BINS) {
+            throw runtime_error("Error: feature bins offsets are corrupt: " + filename);
+        }
+        loaded[f].resize(offsets[f + 1] - offsets[f]);
+        memcpy(loaded[f].data(), values + offsets[f] * sizeof(double),
+               loaded[f].size() * sizeof(double));
+        if (!is_sorted(loaded[f].begin(), loaded[f].end()) ||
+            adjacent_find(loaded[f].begin(), loaded[f].end()) != loaded[f].end()) {
+            throw runtime_error("Error: feature bins edges are not ascending: " + filename);
+        }
+    }
+    edges.swap(loaded);
+}
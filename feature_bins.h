@@ -0,0 +1,69 @@
+#ifndef FEATURE_BINS_H
+#define FEATURE_BINS_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "feature_matrix.h"
+
+// Row-major rows x cols matrix of bin indices, one byte per feature
+struct BinnedMatrix {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<uint8_t> data;
+
+    void resize(size_t r, size_t c) {
+        rows = r;
+        cols = c;
+        data.resize(r * c);
+    }
+
+    uint8_t* row(size_t i) { return data.data() + i * cols; }
+    const uint8_t* row(size_t i) const { return data.data() + i * cols; }
+};
+
+// Per-feature quantization learned from training data. Feature f has
+// ascending edges e_0 < e_1 < ... (at most 255, all values seen in
+// training), and a value x falls in bin(x) = number of edges <= x, so
+//   bin(x) < b   exactly when   x < e_{b-1}.
+// A tree split on bins therefore converts to an ordinary threshold with no
+// loss. Features with at most 256 distinct training values get one bin per
+// value; others get quantile edges.
+class FeatureBinner {
+public:
+    static constexpr int MAX_BINS = 256;
+
+    void fit(const std::vector<std::vector<double>>& X, int max_bins = MAX_BINS);
+    void fit(const FeatureMatrix& X, int max_bins = MAX_BINS);
+
+    size_t size() const { return edges.size(); }
+    int bin_count(size_t f) const { return (int)edges[f].size() + 1; }
+
+    uint8_t bin(size_t f, double x) const;
+
+    // Raw threshold equivalent to the split bin < b (1 <= b < bin_count(f))
+    double edge(size_t f, int b) const { return edges[f][b - 1]; }
+
+    // Split bin < b matching a raw split x < threshold: exact when the
+    // threshold is an edge of f, or an edge rounded to float as compiled
+    // trees store it (as in trees trained on these bins); otherwise the
+    // nearest bin boundary below it
+    int split_bin(size_t f, double threshold) const;
+
+    void transform(const std::vector<std::vector<double>>& X, BinnedMatrix& out) const;
+    void transform(const FeatureMatrix& X, BinnedMatrix& out) const;
+    void transform_row(const feature_t* x, uint8_t* out) const;
+
+    // MODEL_FEATURE_BINS model file (see model_file.h). Both throw
+    // std::runtime_error on failure.
+    void save(const std::string& filename) const;
+    void load(const std::string& filename);
+
+private:
+    std::vector<std::vector<double>> edges;
+
+    void fit_feature(std::vector<double>& values, int max_bins, std::vector<double>& out);
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "feature_cache.h"
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using namespace std;
+
+struct CachePayload {
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t fingerprint;
+};
+
+uint64_t FeatureCache::fingerprint(const PreprocessParams& params) {
+    uint32_t version = FEATURE_PIPELINE_VERSION;
+    uint32_t element_size = sizeof(feature_t);
+    uint64_t h = fnv1a64(&params, sizeof(params));
+    h = fnv1a64(&version, sizeof(version), h);
+    return fnv1a64(&element_size, sizeof(element_size), h);
+}
+
+uint64_t FeatureCache::contentKey(const void* bytes, size_t size) {
+    return fnv1a64(bytes, size);
+}
+
+FeatureCache::FeatureCache(const string& directory, const PreprocessParams& params,
+                           size_t flush_rows)
+    : cols((size_t)params.image_size * params.image_size),
+      print(fingerprint(params)),
+      flush_rows(max(flush_rows, (size_t)1))
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)print);
+    path = (fs::path(directory) / name).string();
+
+    if (!fs::exists(path)) return;
+
+    try {
+        size_t size;
+        const unsigned char* payload = openModelFile(mapped, path, MODEL_FEATURE_CACHE, size);
+
+        CachePayload head;
+        if (size < sizeof(head)) {
+            throw runtime_error("Error: feature cache payload is truncated: " + path);
+        }
+        memcpy(&head, payload, sizeof(head));
+        if (head.fingerprint != print || head.cols != cols ||
+            size != sizeof(head) + head.rows * (sizeof(uint64_t) + cols * sizeof(feature_t))) {
+            throw runtime_error("Error: feature cache does not match its header: " + path);
+        }
+
+        keys = (const uint64_t*)(payload + sizeof(head));
+        rows = (const feature_t*)(keys + head.rows);
+        row_count = head.rows;
+    } catch (const std::exception& e) {
+        cerr << e.what() << " (ignoring cache)" << endl;
+        mapped.close();
+        keys = nullptr;
+        rows = nullptr;
+        row_count = 0;
+    }
+}
+
+bool FeatureCache::lookup(uint64_t key, feature_t* out) {
+    shared_lock<shared_mutex> file_lock(file_mutex);
+    const uint64_t* it = lower_bound(keys, keys + row_count, key);
+    if (it != keys + row_count && *it == key) {
+        const feature_t* row = rows + (size_t)(it - keys) * cols;
+        copy(row, row + cols, out);
+        hit_count++;
+        return true;
+    }
+
+    // Duplicate images within one run hit the rows inserted earlier
+    {
+        lock_guard<mutex> lock(fresh_mutex);
+        auto found = fresh.find(key);
+        if (found != fresh.end()) {
+            copy(found->second.begin(), found->second.end(), out);
+            hit_count++;
+            return true;
+        }
+    }
+
+    miss_count++;
+    return false;
+}
+
+void FeatureCache::insert(uint64_t key, const feature_t* row) {
+    bool full;
+    {
+        lock_guard<mutex> lock(fresh_mutex);
+        fresh.emplace(key, vector<feature_t>(row, row + cols));
+        full = fresh.size() >= flush_rows;
+    }
+    if (full) merge(flush_rows);
+}
+
+void FeatureCache::save() {
+    merge(1);
+}
+
+void FeatureCache::merge(size_t min_rows) {
+    unique_lock<shared_mutex> file_lock(file_mutex);
+    lock_guard<mutex> fresh_lock(fresh_mutex);
+    // Another insert may have flushed while this one waited
+    if (fresh.empty() || fresh.size() < min_rows) return;
+
+    vector<uint64_t> fresh_keys;
+    fresh_keys.reserve(fresh.size());
+    for (const auto& entry : fresh) fresh_keys.push_back(entry.first);
+    sort(fresh_keys.begin(), fresh_keys.end());
+
+    // Merge the sorted mapped keys with the sorted new ones; a key in both
+    // keeps its mapped row. Every mapped row is visited once, in order.
+    auto walk = [&](auto&& old_row, auto&& new_row) {
+        size_t a = 0, b = 0;
+        while (a < row_count || b < fresh_keys.size()) {
+            bool take_old = b == fresh_keys.size() ||
+                            (a < row_count && keys[a] <= fresh_keys[b]);
+            if (take_old) {
+                if (b < fresh_keys.size() && keys[a] == fresh_keys[b]) b++;
+                old_row(a++);
+            } else {
+                new_row(fresh_keys[b++]);
+            }
+        }
+    };
+
+    CachePayload head;
+    head.cols = cols;
+    head.fingerprint = print;
+    head.rows = 0;
+    walk([&](size_t) { head.rows++; }, [&](uint64_t) { head.rows++; });
+
+    // Write beside the old file and swap it in, so an interrupted save
+    // never leaves a half-written cache behind. Old rows are read back
+    // through a stream rather than the mapping, so writing a large cache
+    // does not fault all of it into memory.
+    fs::create_directories(fs::path(path).parent_path());
+    string tmp = path + ".tmp";
+    {
+        ModelFileWriter out(tmp, MODEL_FEATURE_CACHE);
+        out.write(&head, sizeof(head));
+        walk([&](size_t a) { out.write(&keys[a], sizeof(uint64_t)); },
+             [&](uint64_t key) { out.write(&key, sizeof(key)); });
+
+        size_t row_bytes = cols * sizeof(feature_t);
+        ifstream old_rows;
+        if (row_count > 0) {
+            old_rows.open(path, ios::binary);
+            old_rows.seekg(sizeof(ModelHeader) + sizeof(CachePayload) + row_count * sizeof(uint64_t));
+        }
+        vector<feature_t> buffer(cols);
+        walk([&](size_t) {
+                 if (!old_rows.read((char*)buffer.data(), row_bytes)) {
+                     throw runtime_error("Error: failed reading feature cache: " + path);
+                 }
+                 out.write(buffer.data(), row_bytes);
+             },
+             [&](uint64_t key) { out.write(fresh[key].data(), row_bytes); });
+        out.finish();
+    }
+    mapped.close();
+    keys = nullptr;
+    rows = nullptr;
+    row_count = 0;
+    fs::rename(tmp, path);
+
+    // Keep serving lookups from the new file
+    size_t size;
+    const unsigned char* mapped_payload = openModelFile(mapped, path, MODEL_FEATURE_CACHE, size);
+    keys = (const uint64_t*)(mapped_payload + sizeof(head));
+    rows = (const feature_t*)(keys + head.rows);
+    row_count = head.rows;
+    fresh.clear();
+}
@@ -0,0 +1,84 @@
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+#include "image_processor.h"
+#include "feature_matrix.h"
+#include "model_file.h"
+
+// Persistent cache of preprocessed feature rows, keyed by the FNV-1a hash
+// of each image file's bytes. There is one cache file per preprocessing
+// fingerprint (PreprocessParams, feature_t and FEATURE_PIPELINE_VERSION),
+// so changing any of them starts a fresh cache instead of serving stale
+// rows.
+//
+// The file is a MODEL_FEATURE_CACHE model file: CachePayload, then `rows`
+// sorted keys, then the rows x cols feature matrix. It is mapped on open
+// and looked up in place by binary search; rows computed during a run are
+// kept in memory and merged into the file by save(), or as soon as
+// flush_rows of them are waiting, so a cold run over any number of images
+// holds at most flush_rows new rows.
+class FeatureCache {
+public:
+    // Bump whenever imageToRow's output changes for the same parameters
+    static const uint32_t FEATURE_PIPELINE_VERSION = 1;
+
+    // New rows held before they are merged into the file (about 9 MB of
+    // 48x48 float rows)
+    static const size_t DEFAULT_FLUSH_ROWS = 1024;
+
+    // Maps <directory>/<fingerprint>.cache if it exists and is valid;
+    // otherwise starts empty (a corrupt file is reported and ignored)
+    FeatureCache(const std::string& directory, const PreprocessParams& params,
+                 size_t flush_rows = DEFAULT_FLUSH_ROWS);
+
+    static uint64_t fingerprint(const PreprocessParams& params);
+    static uint64_t contentKey(const void* bytes, size_t size);
+
+    // Copy the cached row for `key` into out. Safe to call from many threads.
+    bool lookup(uint64_t key, feature_t* out);
+
+    // Remember a freshly computed row. The call that brings the new rows to
+    // flush_rows merges them into the file first (lookups wait meanwhile).
+    // Safe to call from many threads; throws as save() does.
+    void insert(uint64_t key, const feature_t* row);
+
+    // Write mapped + new rows back to disk if anything was inserted. The
+    // file is streamed out, old rows read back in order, so only the new
+    // rows and their keys are ever in memory.
+    // Throws std::runtime_error on I/O failure.
+    void save();
+
+    size_t hits() const { return hit_count; }
+    size_t misses() const { return miss_count; }
+
+private:
+    std::string path;
+    size_t cols;
+    uint64_t print;
+    size_t flush_rows;
+
+    // Shared by lookups of the mapped file, exclusive while it is replaced
+    std::shared_mutex file_mutex;
+    MappedFile mapped;
+    const uint64_t* keys = nullptr;
+    const feature_t* rows = nullptr;
+    size_t row_count = 0;
+
+    std::mutex fresh_mutex;
+    std::unordered_map<uint64_t, std::vector<feature_t>> fresh;
+
+    std::atomic<size_t> hit_count{0};
+    std::atomic<size_t> miss_count{0};
+
+    // save() if at least min_rows new rows are waiting
+    void merge(size_t min_rows);
+};
+
+#endif
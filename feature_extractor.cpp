@@ -0,0 +1,41 @@
+#include "feature_extractor.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+static const cv::Size HOG_WINDOW(64, 128);
+
+FeatureExtractor::FeatureExtractor(const vector<int>& glcm_distances)
+    : hog(HOG_WINDOW,         // window
+          cv::Size(16, 16),   // block
+          cv::Size(8, 8),     // stride
+          cv::Size(8, 8),     // cell
+          9),                 // bins
+      glcm(glcm_distances)
+{
+    hog_descriptor_size = hog.getDescriptorSize();
+    descriptors.reserve(hog_descriptor_size);
+}
+
+void FeatureExtractor::extract(const string& filename, double* out)
+{
+    cv::Mat image = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+    if (image.empty()) {
+        throw runtime_error("Could not load image: " + filename);
+    }
+    extract(image, out);
+}
+
+void FeatureExtractor::extract(const cv::Mat& gray, double* out)
+{
+    // window and descriptors keep their storage: same size every call
+    cv::resize(gray, window, HOG_WINDOW);
+    hog.compute(window, descriptors);
+    if (descriptors.size() != hog_descriptor_size) {
+        throw runtime_error("HOG returned an unexpected descriptor size");
+    }
+    copy(descriptors.begin(), descriptors.end(), out);
+
+    glcm.compute(gray, out + hog_descriptor_size);
+}
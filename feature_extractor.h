@@ -0,0 +1,44 @@
+#ifndef FEATURE_EXTRACTOR_H
+#define FEATURE_EXTRACTOR_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include "glcm.h"
+
+// HOG + GLCM texture features with everything extractFeatures used to
+// build per call (HOG descriptor, resized window, descriptor and GLCM
+// buffers) kept between images. Features are written straight into a
+// caller-provided row: the HOG descriptor of the image resized to the
+// 64x128 HOG window, then the GlcmEngine statistics of the full image.
+// Not thread-safe; each worker thread owns one.
+class FeatureExtractor {
+public:
+    explicit FeatureExtractor(const std::vector<int>& glcm_distances = {1});
+
+    size_t hog_size() const { return hog_descriptor_size; }
+    size_t glcm_size() const { return glcm.feature_count(); }
+    size_t size() const { return hog_size() + glcm_size(); }
+
+    // Decodes filename as 8-bit grayscale and writes size() features to
+    // out. Throws std::runtime_error if the image cannot be read.
+    void extract(const std::string& filename, double* out);
+
+    // Same for an already decoded 8-bit grayscale image. Once the scratch
+    // buffers have grown to the largest image seen, this code allocates
+    // nothing; what remains is whatever cv::HOGDescriptor::compute
+    // allocates internally (operator new and Mat buffers). bench measures
+    // that baseline and fails its extract check if extract() goes above it.
+    void extract(const cv::Mat& gray, double* out);
+
+private:
+    cv::HOGDescriptor hog;
+    size_t hog_descriptor_size = 0;
+    GlcmEngine glcm;
+
+    cv::Mat window;                 // image resized to the HOG window
+    std::vector<float> descriptors;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef FEATURE_MATRIX_H
+#define FEATURE_MATRIX_H
+
+#include <vector>
+#include <cstddef>
+
+// Element type of every feature matrix. The features are z-scores of 8-bit
+// pixels, which float holds with plenty of precision at half the memory of
+// double; change it here to switch the whole pipeline.
+typedef float feature_t;
+
+// Row-major rows x cols matrix in one contiguous allocation
+struct FeatureMatrix {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<feature_t> data;
+
+    void resize(size_t r, size_t c) {
+        rows = r;
+        cols = c;
+        data.resize(r * c);
+    }
+
+    feature_t* row(size_t i) { return data.data() + i * cols; }
+    const feature_t* row(size_t i) const { return data.data() + i * cols; }
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "glcm.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+GlcmEngine::GlcmEngine(const vector<int>& distances)
+{
+    for (int d : distances) {
+        if (d <= 0) throw runtime_error("GLCM distances must be positive");
+        offs.push_back({d, 0});
+        offs.push_back({d, d});
+        offs.push_back({0, d});
+        offs.push_back({-d, d});
+    }
+    if (offs.empty()) throw runtime_error("GLCM needs at least one distance");
+}
+
+GlcmEngine::GlcmEngine(const vector<GlcmOffset>& offsets) : offs(offsets)
+{
+    if (offs.empty()) throw runtime_error("GLCM needs at least one offset");
+}
+
+// ============ Accumulation ============
+
+// Below this many shared pixel pairs, clearing and summing the joint table
+// costs more than it saves
+static const size_t MIN_JOINT_PAIRS = 65536;
+
+void GlcmEngine::compute(const uint8_t* pixels, int rows, int cols, size_t stride, double* out)
+{
+    rows = max(rows, 0);
+    cols = max(cols, 0);
+    quant.resize((size_t)rows * cols);
+    for (int y = 0; y < rows; y++) {
+        const uint8_t* p = pixels + y * stride;
+        uint8_t* q = quant.data() + (size_t)y * cols;
+        for (int x = 0; x < cols; x++) q[x] = p[x] >> 3;
+    }
+    codes.resize(cols);
+
+    tables.assign(offs.size() * CELLS, 0);
+    size_t k = 0;
+    for (; k + 1 < offs.size(); k += 2) countPair(k, rows, cols);
+    if (k < offs.size()) countSingle(k, cols, span(k, rows, cols));
+
+    for (k = 0; k < offs.size(); k++) statistics(counts(k), out + k * STATS);
+}
+
+// The reference pixels whose offset-k neighbour is inside the image
+GlcmEngine::Span GlcmEngine::span(size_t k, int rows, int cols) const
+{
+    const GlcmOffset& o = offs[k];
+    return {max(0, -o.dy), rows - max(0, o.dy), max(0, -o.dx), cols - max(0, o.dx)};
+}
+
+void GlcmEngine::countSingle(size_t k, int cols, const Span& s)
+{
+    if (s.y1 <= s.y0 || s.x1 <= s.x0) return;
+    const GlcmOffset& o = offs[k];
+    uint32_t* t = tables.data() + k * CELLS;
+    uint16_t* c = codes.data();
+    int n = s.x1 - s.x0;
+    for (int y = s.y0; y < s.y1; y++) {
+        const uint8_t* a = quant.data() + (size_t)y * cols + s.x0;
+        const uint8_t* b = quant.data() + (size_t)(y + o.dy) * cols + s.x0 + o.dx;
+        // Indexes first, in a loop the compiler vectorizes, then the
+        // scattered increments on their own
+        for (int x = 0; x < n; x++) c[x] = (uint16_t)(a[x] * LEVELS + b[x]);
+        for (int x = 0; x < n; x++) t[c[x]]++;
+    }
+}
+
+// Offsets k and k + 1 through the joint table over the pixels both can
+// use; the rest of each offset's pairs (a few edge rows and columns) are
+// counted on their own
+void GlcmEngine::countPair(size_t k, int rows, int cols)
+{
+    Span s1 = span(k, rows, cols), s2 = span(k + 1, rows, cols);
+    Span both = {max(s1.y0, s2.y0), min(s1.y1, s2.y1), max(s1.x0, s2.x0), min(s1.x1, s2.x1)};
+    if (both.y1 <= both.y0 || both.x1 <= both.x0 ||
+        (size_t)(both.y1 - both.y0) * (both.x1 - both.x0) < MIN_JOINT_PAIRS) {
+        countSingle(k, cols, s1);
+        countSingle(k + 1, cols, s2);
+        return;
+    }
+
+    const GlcmOffset& o1 = offs[k];
+    const GlcmOffset& o2 = offs[k + 1];
+    joint.assign(JOINT_CELLS, 0);
+    uint16_t* c = codes.data();
+    int n = both.x1 - both.x0;
+    for (int y = both.y0; y < both.y1; y++) {
+        const uint8_t* a = quant.data() + (size_t)y * cols + both.x0;
+        const uint8_t* b1 = quant.data() + (size_t)(y + o1.dy) * cols + both.x0 + o1.dx;
+        const uint8_t* b2 = quant.data() + (size_t)(y + o2.dy) * cols + both.x0 + o2.dx;
+        for (int x = 0; x < n; x++) c[x] = (uint16_t)((a[x] * LEVELS + b1[x]) * LEVELS + b2[x]);
+        for (int x = 0; x < n; x++) joint[c[x]]++;
+    }
+
+    // Summed over neighbour 2 the joint cell [a][b1][b2] counts offset k's
+    // pair (a, b1), summed over neighbour 1 offset k + 1's pair (a, b2)
+    uint32_t* t1 = tables.data() + k * CELLS;
+    uint32_t* t2 = t1 + CELLS;
+    for (int ab = 0; ab < CELLS; ab++) {
+        const uint32_t* cell = joint.data() + (size_t)ab * LEVELS;
+        uint32_t* row2 = t2 + (ab / LEVELS) * LEVELS;
+        uint32_t sum = 0;
+        for (int b = 0; b < LEVELS; b++) {
+            sum += cell[b];
+            row2[b] += cell[b];
+        }
+        t1[ab] += sum;
+    }
+
+    for (size_t j = k; j < k + 2; j++) {
+        const Span& s = j == k ? s1 : s2;
+        countSingle(j, cols, {s.y0, both.y0, s.x0, s.x1});
+        countSingle(j, cols, {both.y1, s.y1, s.x0, s.x1});
+        countSingle(j, cols, {both.y0, both.y1, s.x0, both.x0});
+        countSingle(j, cols, {both.y0, both.y1, both.x1, s.x1});
+    }
+}
+
+void GlcmEngine::compute(const cv::Mat& gray, double* out)
+{
+    if (gray.type() != CV_8UC1) throw runtime_error("GLCM needs an 8-bit grayscale image");
+    compute(gray.ptr<uchar>(0), gray.rows, gray.cols, gray.step1(), out);
+}
+
+vector<double> GlcmEngine::compute(const cv::Mat& gray)
+{
+    vector<double> out(feature_count());
+    compute(gray, out.data());
+    return out;
+}
+
+// ============ Statistics ============
+
+// With n pairs and p = c / n:
+//   contrast    = sum (i-j)^2 p       = sum_d d^2 diag[d] / n
+//   homogeneity = sum p / (1 + |i-j|) = sum_d diag[d] / (1 + d) / n
+//   energy      = sum p^2             = sum c^2 / n^2
+//   entropy     = -sum p log2 p       = log2 n - sum c log2 c / n
+// where diag[d] sums the counts with |i-j| == d. The sums over counts are
+// exact in integers, which also lets the compiler vectorize them.
+void GlcmEngine::statistics(const uint32_t* c, double* out) const
+{
+    uint64_t n = 0, squares = 0;
+    for (int i = 0; i < CELLS; i++) {
+        n += c[i];
+        squares += (uint64_t)c[i] * c[i];
+    }
+    if (n == 0) {
+        fill(out, out + STATS, 0.0);
+        return;
+    }
+
+    uint64_t diag[LEVELS];
+    for (int d = 0; d < LEVELS; d++) {
+        uint64_t s = 0;
+        for (int i = 0; i + d < LEVELS; i++) s += c[i * LEVELS + i + d];
+        if (d > 0)
+            for (int i = 0; i + d < LEVELS; i++) s += c[(i + d) * LEVELS + i];
+        diag[d] = s;
+    }
+
+    double contrast = 0, homogeneity = 0;
+    for (int d = 0; d < LEVELS; d++) {
+        contrast += (double)d * d * diag[d];
+        homogeneity += diag[d] / (1.0 + d);
+    }
+
+    double xlogx = 0;
+    for (int i = 0; i < CELLS; i++)
+        if (c[i]) xlogx += c[i] * log2((double)c[i]);
+
+    double inv = 1.0 / n;
+    out[0] = contrast * inv;
+    out[1] = (double)squares * inv * inv;
+    out[2] = homogeneity * inv;
+    out[3] = log2((double)n) - xlogx * inv;
+}
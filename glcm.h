@@ -0,0 +1,70 @@
+#ifndef GLCM_H
+#define GLCM_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Pixel (x, y) is paired with (x + dx, y + dy); rows grow downwards
+struct GlcmOffset {
+    int dx;
+    int dy;
+};
+
+// Gray-level co-occurrence statistics for several offsets at once. The
+// image is quantized to LEVELS gray levels (value >> 3) and the integer
+// co-occurrence counts are accumulated two offsets at a time: each pixel
+// bumps one cell of a joint (reference, neighbour 1, neighbour 2) table,
+// which is then summed down to the two offsets' tables, so an offset costs
+// half a scattered increment per pixel. The statistics are computed from
+// the integer counts. compute() reuses its buffers, so after the first
+// image of a given size it does not allocate. An engine is not
+// thread-safe; use one per thread.
+class GlcmEngine {
+public:
+    static constexpr int LEVELS = 32;
+    // Per offset: contrast, energy, homogeneity, entropy
+    static constexpr int STATS = 4;
+
+    // 0, 45, 90 and 135 degrees at every distance, i.e. (d, 0), (d, d),
+    // (0, d) and (-d, d), in that order for each distance
+    explicit GlcmEngine(const std::vector<int>& distances = {1});
+    explicit GlcmEngine(const std::vector<GlcmOffset>& offsets);
+
+    const std::vector<GlcmOffset>& offsets() const { return offs; }
+    size_t feature_count() const { return offs.size() * STATS; }
+
+    // Writes feature_count() values to out, STATS per offset in offsets()
+    // order. An offset with no pixel pairs in the image yields zeros.
+    void compute(const uint8_t* pixels, int rows, int cols, size_t stride, double* out);
+    // 8-bit single-channel image
+    void compute(const cv::Mat& gray, double* out);
+    std::vector<double> compute(const cv::Mat& gray);
+
+    // LEVELS x LEVELS counts of offset k from the last compute(), indexed
+    // [reference level * LEVELS + neighbour level]
+    const uint32_t* counts(size_t k) const { return tables.data() + k * CELLS; }
+
+private:
+    static constexpr int CELLS = LEVELS * LEVELS;
+    static constexpr int JOINT_CELLS = CELLS * LEVELS;
+
+    std::vector<GlcmOffset> offs;
+    std::vector<uint8_t> quant;     // quantized image, rows x cols
+    std::vector<uint32_t> tables;   // CELLS counts per offset
+    // [reference][neighbour 1][neighbour 2] counts of the offset pair being
+    // accumulated; sized on the first image large enough to use it
+    std::vector<uint32_t> joint;
+    std::vector<uint16_t> codes;    // one row of table indexes
+
+    // Reference pixels y0 <= y < y1, x0 <= x < x1
+    struct Span { int y0, y1, x0, x1; };
+
+    Span span(size_t k, int rows, int cols) const;
+    void countSingle(size_t k, int cols, const Span& s);
+    void countPair(size_t k, int rows, int cols);
+    void statistics(const uint32_t* c, double* out) const;
+};
+
+#endif
@@ -1,98 +1,28 @@
 #include "image_processor.h"
+#include "feature_extractor.h"
+#include "profiler.h"
 #include <iostream>
+#include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <filesystem>
 using namespace cv;
 using namespace std;
 
-void computeGLCMFeatures(const Mat& gray, double& contrast, double& energy,
-                         double& homogeneity, double& entropy)
-{
-    // Quantize to reduce matrix size (0–255 → 0–31)
-    Mat quant = gray.clone();
-    quant.convertTo(quant, CV_8U, 1.0 / 8.0);  // proper scaling 0–255 → 0–31
-
-    const int levels = 32;
-    Mat glcm = Mat::zeros(levels, levels, CV_64F);
-
-    // GLCM: offset (dx = 1, dy = 0) → horizontal relationship
-    for (int i = 0; i < quant.rows; i++) {
-        for (int j = 0; j < quant.cols - 1; j++) {
-            int a = quant.at<uchar>(i, j);
-            int b = quant.at<uchar>(i, j + 1);
-            glcm.at<double>(a, b)++;
-        }
-    }
-
-    // Normalize
-    glcm /= sum(glcm)[0];
-
-    contrast = energy = homogeneity = entropy = 0.0;
-
-    for (int i = 0; i < levels; i++) {
-        for (int j = 0; j < levels; j++) {
-            double p = glcm.at<double>(i,j);
-            if (p <= 0) continue;
-
-            contrast += (i - j) * (i - j) * p;
-            energy   += p * p;
-            homogeneity += p / (1.0 + abs(i - j));
-            entropy  += -p * log2(p);
-        }
-    }
-}
-
-vector<float> computeHOG(const Mat& gray)
-{
-    vector<float> descriptors;
-    
-    try {
-        HOGDescriptor hog(
-            Size(64,128), // window
-            Size(16,16),  // block
-            Size(8,8),    // stride
-            Size(8,8),    // cell
-            9             // bins
-        );
-
-        Mat resized;
-        resize(gray, resized, Size(64,128));
-
-        hog.compute(resized, descriptors);
-    } catch (const std::exception& e) {
-        cout << "HOG computation failed: " << e.what() << endl;
-        // Return empty vector on failure
-        descriptors.clear();
-    }
-    
-    return descriptors;
-}
-
 vector<double> extractFeatures(const string& filename) {
+    // One extractor per thread keeps the HOG descriptor and buffers
+    // between calls
+    thread_local FeatureExtractor extractor;
     vector<double> re;
-    
-    try {
-        Mat img = imread(filename, IMREAD_GRAYSCALE);
-        if (img.empty()) {
-            cout << "Warning: Could not load image: " << filename << endl;
-            return re;  // Return empty vector
-        }
 
-        // ---- GLCM features ----
-        double contrast, energy, homogeneity, entropy;
-        computeGLCMFeatures(img, contrast, energy, homogeneity, entropy);
-
-        // ---- HOG ----
-        vector<float> hogFeatures = computeHOG(img);
-
-        for(float i : hogFeatures) re.push_back(i);
-        re.push_back(contrast);
-        re.push_back(energy);
-        re.push_back(homogeneity);
-        re.push_back(entropy);
+    try {
+        re.resize(extractor.size());
+        extractor.extract(filename, re.data());
     } catch (const std::exception& e) {
         cout << "Error in extractFeatures for " << filename << ": " << e.what() << endl;
+        re.clear();
     }
-    
+
     return re;
 }
 
@@ -107,9 +37,93 @@ vector<double> flatten(const std::vector<std::vector<double>> &image){
     return re;
 }
 
-std::vector<std::vector<double>> imageToVector(const std::string& filename) {
-    // Step 1: Load the image
-    cv::Mat image = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+// ============ Decoding ============
+
+bool jpegSize(const unsigned char* bytes, size_t size, int& width, int& height) {
+    if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) return false;
+
+    // Walk the marker segments up to the first start-of-frame
+    size_t i = 2;
+    while (i + 4 <= size) {
+        if (bytes[i] != 0xFF) return false;
+        unsigned char marker = bytes[i + 1];
+        if (marker == 0xFF) { i++; continue; }  // fill byte
+        i += 2;
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) continue;  // no length
+        if (marker == 0xD9 || marker == 0xDA) return false;  // EOI or scan before any frame
+
+        size_t length = ((size_t)bytes[i] << 8) | bytes[i + 1];
+        if (length < 2) return false;
+        // SOF0..SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        bool frame = marker >= 0xC0 && marker <= 0xCF &&
+                     marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (frame) {
+            // precision, height, width
+            if (i + 7 > size) return false;
+            height = (bytes[i + 3] << 8) | bytes[i + 4];
+            width = (bytes[i + 5] << 8) | bytes[i + 6];
+            return width > 0 && height > 0;
+        }
+        i += length;
+    }
+    return false;
+}
+
+int decodeFlags(const unsigned char* bytes, size_t size, const PreprocessParams& params) {
+    int width, height;
+    if (params.reduced_decode == 0 || !jpegSize(bytes, size, width, height)) {
+        return IMREAD_GRAYSCALE;
+    }
+
+    // libjpeg rounds scaled dimensions up
+    long shorter = min(width, height);
+    long needed = (long)params.reduced_decode * params.image_size;
+    if ((shorter + 7) / 8 >= needed) return IMREAD_REDUCED_GRAYSCALE_8;
+    if ((shorter + 3) / 4 >= needed) return IMREAD_REDUCED_GRAYSCALE_4;
+    if ((shorter + 1) / 2 >= needed) return IMREAD_REDUCED_GRAYSCALE_2;
+    return IMREAD_GRAYSCALE;
+}
+
+Mat decodeImage(const vector<uchar>& bytes, const PreprocessParams& params) {
+    PROFILE_SCOPE("decode");
+    return imdecode(bytes, decodeFlags(bytes.data(), bytes.size(), params));
+}
+
+// For the bytes_read counter when imread does the reading
+static uintmax_t fileSize(const string& filename) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(filename, ec);
+    return ec ? 0 : size;
+}
+
+Mat loadImage(const string& filename, const PreprocessParams& params) {
+    if (params.reduced_decode == 0) {
+        PROFILE_COUNT("bytes_read", fileSize(filename));
+        PROFILE_SCOPE("decode");  // imread reads and decodes
+        return imread(filename, IMREAD_GRAYSCALE);
+    }
+
+    // The decode mode depends on the header, so read the bytes first
+    vector<uchar> bytes;
+    {
+        PROFILE_SCOPE("read");
+        ifstream in(filename, ios::binary | ios::ate);
+        if (!in) return Mat();
+        streamsize size = in.tellg();
+        in.seekg(0);
+        bytes.resize((size_t)max<streamsize>(size, 0));
+        if (size > 0 && !in.read((char*)bytes.data(), size)) return Mat();
+        PROFILE_COUNT("bytes_read", size);
+    }
+    return decodeImage(bytes, params);
+}
+
+// ============ Preprocessing ============
+
+std::vector<std::vector<double>> imageToVector(const std::string& filename,
+                                               const PreprocessParams& params) {
+    // Step 1: Load the image (at reduced resolution if params allow)
+    cv::Mat image = loadImage(filename, params);
     
     // Check if image was loaded successfully
     if (image.empty()) {
@@ -118,11 +132,16 @@ std::vector<std::vector<double>> imageToVector(const std::string& filename) {
     
     // Step 1.5: Enhance contrast with histogram equalization
     cv::Mat enhanced;
-    cv::equalizeHist(image, enhanced);
+    if (params.equalize_hist) {
+        cv::equalizeHist(image, enhanced);
+    } else {
+        enhanced = image;
+    }
     
-    // Step 2: Resize to 48x48 (good balance of detail and speed)
+    // Step 2: Resize to image_size x image_size (48x48 by default: good balance of detail and speed)
+    int size = (int)params.image_size;
     cv::Mat resized;
-    cv::resize(enhanced, resized, cv::Size(48, 48), 0, 0, cv::INTER_CUBIC);
+    cv::resize(enhanced, resized, cv::Size(size, size), 0, 0, (int)params.interpolation);
     
     // Step 3: Normalize with z-score
     cv::Mat normalized;
@@ -149,3 +168,59 @@ std::vector<std::vector<double>> imageToVector(const std::string& filename) {
     
     return result;
 }
+
+void imageToRow(const std::string& filename, feature_t* out,
+                const PreprocessParams& params) {
+    // Load exactly as imageToVector does
+    cv::Mat image = loadImage(filename, params);
+    if (image.empty()) {
+        throw std::runtime_error("Error: Could not open or find the image: " + filename);
+    }
+
+    matToRow(image, out, params);
+}
+
+void matToRow(const cv::Mat& image, feature_t* out, const PreprocessParams& params) {
+    cv::Mat enhanced;
+    if (params.equalize_hist) {
+        PROFILE_SCOPE("equalize_hist");
+        cv::equalizeHist(image, enhanced);
+    } else {
+        enhanced = image;
+    }
+
+    int size = (int)params.image_size;
+    cv::Mat resized;
+    {
+        PROFILE_SCOPE("resize");
+        cv::resize(enhanced, resized, cv::Size(size, size), 0, 0, (int)params.interpolation);
+    }
+
+    PROFILE_SCOPE("normalize");
+    // Z-score over the 8-bit pixels scaled to [0, 1]: one pass for the
+    // moments, one pass writing the output row
+    const double scale = 1.0 / 255.0;
+    double sum = 0, sq_sum = 0;
+    for (int i = 0; i < size; i++) {
+        const uchar* p = resized.ptr<uchar>(i);
+        for (int j = 0; j < size; j++) {
+            double v = p[j] * scale;
+            sum += v;
+            sq_sum += v * v;
+        }
+    }
+
+    double n = (double)size * size;
+    double mean = sum / n;
+    double stddev = sqrt(std::max(sq_sum / n - mean * mean, 0.0));
+    double inv_stddev = (stddev > 1e-10) ? 1.0 / stddev : 1.0;
+    if (stddev <= 1e-10) mean = 0.0;
+
+    for (int i = 0; i < size; i++) {
+        const uchar* p = resized.ptr<uchar>(i);
+        feature_t* o = out + (size_t)i * size;
+        for (int j = 0; j < size; j++) {
+            o[j] = (feature_t)((p[j] * scale - mean) * inv_stddev);
+        }
+    }
+}
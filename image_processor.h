@@ -5,9 +5,51 @@
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <cstdint>
+#include "feature_matrix.h"
 
-// Function to load image, resize to 64x64, and convert to vector<vector<double>>
-std::vector<std::vector<double>> imageToVector(const std::string& filename);
+// Parameters of the imageToVector pipeline. Trained models store the values
+// they were built with, so inference preprocesses exactly the same way.
+struct PreprocessParams {
+    uint32_t image_size = 48;                    // output is image_size x image_size
+    uint32_t equalize_hist = 1;                  // histogram equalization before resizing
+    uint32_t interpolation = cv::INTER_CUBIC;    // cv::resize interpolation flag
+    // 0 decodes at full resolution. N > 0 lets JPEGs decode at 1/2, 1/4 or
+    // 1/8 scale (libjpeg DCT scaling), the smallest that keeps the shorter
+    // side at least N * image_size; the usual resize then finishes the job.
+    // Other formats always decode at full resolution.
+    uint32_t reduced_decode = 0;
+};
+
+// Width and height from a JPEG's frame header, without decoding it;
+// false if bytes is not a JPEG or no frame header was found
+bool jpegSize(const unsigned char* bytes, size_t size, int& width, int& height);
+
+// cv::imread/imdecode flag for these encoded bytes under params:
+// IMREAD_GRAYSCALE or one of the IMREAD_REDUCED_GRAYSCALE_* modes
+int decodeFlags(const unsigned char* bytes, size_t size, const PreprocessParams& params);
+
+// Decode to 8-bit grayscale, reduced as params.reduced_decode allows.
+// Empty if the bytes (or the file) cannot be decoded.
+cv::Mat decodeImage(const std::vector<uchar>& bytes, const PreprocessParams& params);
+cv::Mat loadImage(const std::string& filename, const PreprocessParams& params);
+
+// Function to load image, resize to image_size x image_size, and convert to vector<vector<double>>
+std::vector<std::vector<double>> imageToVector(const std::string& filename,
+                                               const PreprocessParams& params = PreprocessParams());
+// Same preprocessing as imageToVector, but the image_size x image_size
+// features are written straight into out (row-major); the decoded,
+// equalized and resized Mats are the only buffers allocated on the way.
+// Throws std::runtime_error if the image cannot be read.
+void imageToRow(const std::string& filename, feature_t* out,
+                const PreprocessParams& params = PreprocessParams());
+
+// imageToRow for an already decoded 8-bit grayscale image
+void matToRow(const cv::Mat& image, feature_t* out,
+              const PreprocessParams& params = PreprocessParams());
+
+// FeatureExtractor::extract (feature_extractor.h) into a new vector, using
+// one extractor per calling thread; empty if the image cannot be read
 std::vector<double> extractFeatures(const std::string& filename);
 std::vector<double> flatten(const std::vector<std::vector<double>> &image);
 
@@ -0,0 +1,302 @@
+#include "inference_server.h"
+#include "centroid_scorer.h"
+#include "image_processor.h"
+#include "unix_socket.h"
+#include "profiler.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <deque>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <stdexcept>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static long long microsSince(Clock::time_point start, Clock::time_point end)
+{
+    return chrono::duration_cast<chrono::microseconds>(end - start).count();
+}
+
+// ============ Batching ============
+
+// One preprocessed row waiting to be scored; filled in by the scoring thread
+struct ScoreRequest {
+    const feature_t* row = nullptr;
+    double score = 0.0;
+    int tree_label = -1;
+    size_t batch_size = 0;
+    Clock::time_point queued, started;
+    bool done = false;
+};
+
+// Connection threads submit rows and block; one thread takes everything
+// pending (up to max_batch) and scores it in a single pass, so concurrent
+// requests share the model's cache-resident weights and the tree's
+// interleaved batch walk.
+class ScoreBatcher {
+public:
+    ScoreBatcher(const CentroidScorer& scorer, DecisionTree* tree, size_t cols, size_t max_batch)
+        : scorer(scorer), tree(tree), cols(cols), max_batch(max(max_batch, (size_t)1))
+    {
+        worker = thread([this] { run(); });
+    }
+
+    ~ScoreBatcher()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        worker.join();
+    }
+
+    // Blocks until request.row has been scored
+    void score(ScoreRequest& request)
+    {
+        unique_lock<mutex> lock(m);
+        request.queued = Clock::now();
+        pending.push_back(&request);
+        work_cv.notify_one();
+        done_cv.wait(lock, [&] { return request.done; });
+    }
+
+private:
+    void run()
+    {
+        vector<ScoreRequest*> batch;
+        vector<double> tree_rows;
+        vector<int> tree_labels;
+
+        for (;;) {
+            {
+                unique_lock<mutex> lock(m);
+                work_cv.wait(lock, [&] { return stopping || !pending.empty(); });
+                if (pending.empty()) return;
+                size_t n = min(pending.size(), max_batch);
+                batch.assign(pending.begin(), pending.begin() + n);
+                pending.erase(pending.begin(), pending.begin() + n);
+            }
+
+            auto started = Clock::now();
+            {
+                PROFILE_SCOPE("score_batch");
+                for (ScoreRequest* r : batch) r->score = scorer.score(r->row);
+            }
+
+            if (tree) {
+                PROFILE_SCOPE("tree_batch");
+                tree_rows.resize(batch.size() * cols);
+                tree_labels.resize(batch.size());
+                for (size_t i = 0; i < batch.size(); i++) {
+                    copy(batch[i]->row, batch[i]->row + cols, tree_rows.begin() + i * cols);
+                }
+                tree->predict_batch(tree_rows.data(), batch.size(), cols, tree_labels.data());
+                for (size_t i = 0; i < batch.size(); i++) batch[i]->tree_label = tree_labels[i];
+            }
+
+            {
+                lock_guard<mutex> lock(m);
+                for (ScoreRequest* r : batch) {
+                    r->batch_size = batch.size();
+                    r->started = started;
+                    r->done = true;
+                }
+            }
+            done_cv.notify_all();
+        }
+    }
+
+    const CentroidScorer& scorer;
+    DecisionTree* tree;
+    size_t cols;
+    size_t max_batch;
+
+    mutex m;
+    condition_variable work_cv, done_cv;
+    deque<ScoreRequest*> pending;
+    bool stopping = false;
+    thread worker;
+};
+
+// ============ Connections ============
+
+// Error text on one line
+static string replyError(const string& message)
+{
+    string re = "ERR " + message;
+    for (char& c : re) {
+        if (c == '\n' || c == '\r') c = ' ';
+    }
+    return re + "\n";
+}
+
+static void serveConnection(int fd, const PreprocessParams& params, size_t cols,
+                            ScoreBatcher& batcher, const ServerOptions& options,
+                            atomic<size_t>& served)
+{
+    SocketReader in(fd);
+    string line;
+    vector<uchar> bytes;
+    vector<feature_t> row(cols);
+    ostringstream reply;
+    reply << setprecision(numeric_limits<double>::max_digits10);
+
+    while (in.readLine(line)) {
+        auto received = Clock::now();
+        PROFILE_SCOPE("request");  // through the reply being written
+        bool keep_open = true;
+        reply.str("");
+
+        try {
+            if (line.compare(0, 5, "PATH ") == 0) {
+                imageToRow(line.substr(5), row.data(), params);
+            } else if (line.compare(0, 6, "BYTES ") == 0) {
+                // A bad length leaves the stream unframed, so drop the connection after replying
+                size_t n = 0;
+                try { n = stoull(line.substr(6)); } catch (...) { keep_open = false; throw runtime_error("bad BYTES length"); }
+                if (n == 0 || n > options.max_image_bytes) {
+                    keep_open = false;
+                    throw runtime_error("image size " + to_string(n) + " outside 1.." + to_string(options.max_image_bytes));
+                }
+                bytes.resize(n);
+                if (!in.readExact(bytes.data(), n)) break;
+                PROFILE_COUNT("bytes_read", n);
+                cv::Mat image = decodeImage(bytes, params);
+                if (image.empty()) throw runtime_error("could not decode image bytes");
+                matToRow(image, row.data(), params);
+            } else {
+                keep_open = false;
+                throw runtime_error("unknown request (expected PATH or BYTES)");
+            }
+
+            ScoreRequest request;
+            request.row = row.data();
+            batcher.score(request);
+            PROFILE_COUNT("images", 1);
+
+            int label = request.score > options.threshold ? 1 : 0;
+            reply << "OK " << request.score << ' ' << label << ' ' << request.tree_label
+                  << ' ' << request.batch_size << ' ' << microsSince(request.queued, request.started)
+                  << ' ' << microsSince(received, Clock::now()) << '\n';
+        } catch (const exception& e) {
+            reply.str(replyError(e.what()));
+        }
+
+        if (!writeAll(fd, reply.str()) || !keep_open) break;
+        served++;
+    }
+}
+
+// ============ Accept loop ============
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int)
+{
+    stop_requested = 1;
+}
+
+void runInferenceServer(const CentroidModel& model, DecisionTree* tree,
+                        const ServerOptions& options)
+{
+    size_t cols = (size_t)model.preprocess.image_size * model.preprocess.image_size;
+    if (cols != model.num_features) {
+        throw runtime_error("Error: model expects " + to_string(model.num_features) +
+                            " features but images produce " + to_string(cols));
+    }
+    if (tree && !tree->compiled()) tree->compile();
+    if (tree && tree->feature_span() > cols) {
+        throw runtime_error("Error: decision tree uses feature " + to_string(tree->feature_span() - 1) +
+                            " but images produce " + to_string(cols));
+    }
+
+    CentroidScorer scorer(model);
+    ScoreBatcher batcher(scorer, tree, cols, options.max_batch);
+
+    int listen_fd = listenUnix(options.socket_path);
+    stop_requested = 0;
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+#ifdef SIGPIPE
+    signal(SIGPIPE, SIG_IGN);    // a client hanging up must not kill the server
+#endif
+
+    cerr << "Serving on " << options.socket_path << " (kernel " << scorer.kernel()
+         << (tree ? ", with decision tree" : "") << "); Ctrl-C to stop" << endl;
+
+    struct Connection {
+        int fd;
+        thread worker;
+        atomic<bool> finished{false};
+    };
+    list<Connection> connections;
+    atomic<size_t> served{0};
+
+    // Reap finished connections so long-running servers don't accumulate threads
+    auto reap = [&] {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->finished) {
+                it->worker.join();
+                closeSocket(it->fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    size_t refused = 0;
+    while (!stop_requested) {
+        reap();
+
+        // Wake periodically to notice the stop signal
+        int fd = acceptUnix(listen_fd, 250);
+        if (fd < 0) continue;
+
+        // Every connection holds a thread, so past the limit new ones are
+        // turned away rather than left waiting for a slot
+        reap();
+        if (options.max_connections > 0 && connections.size() >= options.max_connections) {
+            writeAll(fd, replyError("too many connections"));
+            closeSocket(fd);
+            if (refused++ == 0) {
+                cerr << "Refusing connections over the limit of " << options.max_connections << endl;
+            }
+            continue;
+        }
+
+        connections.emplace_back();
+        Connection& c = connections.back();
+        c.fd = fd;
+        c.worker = thread([&c, &model, cols, &batcher, &options, &served] {
+            serveConnection(c.fd, model.preprocess, cols, batcher, options, served);
+            c.finished = true;
+        });
+    }
+
+    // Wake every connection blocked on a read, then wait for them
+    for (Connection& c : connections) shutdownSocket(c.fd);
+    for (Connection& c : connections) {
+        c.worker.join();
+        closeSocket(c.fd);
+    }
+    closeSocket(listen_fd);
+    removeSocketFile(options.socket_path);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    cerr << "Stopped after " << served << " requests";
+    if (refused > 0) cerr << " (" << refused << " connections refused)";
+    cerr << endl;
+}
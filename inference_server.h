@@ -0,0 +1,43 @@
+#ifndef INFERENCE_SERVER_H
+#define INFERENCE_SERVER_H
+
+#include <string>
+#include <cstddef>
+#include "centroid_model.h"
+#include "decision_tree.h"
+
+// Long-running scorer on a Unix domain socket. The model is loaded once;
+// each connection is handled by its own thread, which decodes and
+// preprocesses the image, then hands the row to a single scoring thread
+// that scores whatever rows are waiting as one batch. A connection
+// arriving while max_connections are open gets one
+// "ERR too many connections" line and is closed.
+//
+// Protocol, one request per line (several may be pipelined on a
+// connection, replies come back in order):
+//   PATH <file>\n           image file readable by the server
+//   BYTES <n>\n<n bytes>    encoded image (PNG, JPEG, ...) sent inline
+// Reply, one line each:
+//   OK <score> <label> <tree_label> <batch> <queue_us> <server_us>\n
+//   ERR <message>\n
+// label is 1 (Tuberculosis) when score > threshold; tree_label is the
+// decision tree's class, or -1 without a tree. batch is how many rows
+// were scored together, queue_us how long this one waited for the
+// scoring thread and server_us the time from reading the request to
+// sending the reply.
+struct ServerOptions {
+    std::string socket_path;
+    double threshold = 0.0;
+    size_t max_batch = 64;                 // rows per scoring pass
+    size_t max_image_bytes = 64u << 20;    // larger BYTES requests are refused
+    size_t max_connections = 256;          // open at once (one thread each); 0: no limit
+};
+
+// Serve until SIGINT or SIGTERM, then remove the socket file. tree may be
+// null; if given it must be compiled (as load() leaves it). Throws
+// runtime_error if the socket cannot be set up or the tree does not fit
+// the model's feature width.
+void runInferenceServer(const CentroidModel& model, DecisionTree* tree,
+                        const ServerOptions& options);
+
+#endif
@@ -0,0 +1,258 @@
+#include "ingest.h"
+#include "bounded_queue.h"
+#include "profiler.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using namespace std;
+
+struct IngestJob {
+    size_t row;
+    string path;
+};
+
+struct IngestResult {
+    size_t row;
+    string name;
+    vector<feature_t> features;  // pooled buffer, returned by the collector
+};
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static double perSecond(size_t count, double seconds) {
+    return seconds > 0 ? count / seconds : 0.0;
+}
+
+// Read the whole file into bytes (reusing its capacity)
+static void readFile(const string& path, vector<uchar>& bytes) {
+    PROFILE_SCOPE("read");
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) {
+        throw runtime_error("Error: Could not open or find the image: " + path);
+    }
+    streamsize size = in.tellg();
+    in.seekg(0);
+    bytes.resize((size_t)size);
+    if (size > 0 && !in.read((char*)bytes.data(), size)) {
+        throw runtime_error("Error: Could not read the image: " + path);
+    }
+    PROFILE_COUNT("bytes_read", size);
+}
+
+// Fill out from the cache when the file's content is known, decoding it
+// from the bytes already in memory otherwise
+static void cachedImageToRow(const string& path, feature_t* out,
+                             const PreprocessParams& params, FeatureCache& cache,
+                             vector<uchar>& bytes)
+{
+    readFile(path, bytes);
+    uint64_t key;
+    {
+        PROFILE_SCOPE("cache_lookup");
+        key = FeatureCache::contentKey(bytes.data(), bytes.size());
+        if (cache.lookup(key, out)) return;
+    }
+
+    cv::Mat image = decodeImage(bytes, params);
+    if (image.empty()) {
+        throw runtime_error("Error: Could not open or find the image: " + path);
+    }
+    matToRow(image, out, params);
+    cache.insert(key, out);
+}
+
+bool streamDirectory(const string& directory_path, const PreprocessParams& params,
+                     const RowConsumer& consume, int threads, FeatureCache* cache,
+                     ostream& log)
+{
+    if (!fs::exists(directory_path) || !fs::is_directory(directory_path)) {
+        std::cerr << "Error: Directory '" << directory_path << "' does not exist or is not a directory." << std::endl;
+        return false;
+    }
+
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+
+    // A couple of jobs per worker keeps everyone busy without letting the
+    // lister or the decoders run far ahead of the next stage
+    BoundedQueue<IngestJob> jobs(2 * threads);
+    BoundedQueue<IngestResult> results(2 * threads);
+
+    // Enough row buffers for a full results queue, one per worker and one
+    // for the collector; a worker waits here if the collector falls behind
+    size_t cols = (size_t)params.image_size * params.image_size;
+    size_t pool_size = 3 * threads + 1;
+    BoundedQueue<vector<feature_t>> free_buffers(pool_size);
+    for (size_t i = 0; i < pool_size; i++) free_buffers.push(vector<feature_t>(cols));
+
+    atomic<size_t> listed{0}, decoded{0};
+    atomic<bool> listing_done{false};
+    atomic<int> running_workers{threads};
+    double list_seconds = 0, decode_seconds = 0;
+
+    mutex error_mutex;
+    exception_ptr error;
+    auto fail = [&](exception_ptr e) {
+        {
+            lock_guard<mutex> lock(error_mutex);
+            if (!error) error = e;
+        }
+        jobs.close();
+        results.close();
+        free_buffers.close();
+    };
+
+    auto start = chrono::steady_clock::now();
+
+    // ---- Stage 1: list ----
+    thread lister([&] {
+        try {
+            for (const auto& entry : fs::directory_iterator(directory_path)) {
+                if (!fs::is_regular_file(entry.status())) continue;
+                if (!jobs.push({listed.load(), entry.path().string()})) break;
+                listed++;
+            }
+        } catch (...) {
+            fail(current_exception());
+        }
+        list_seconds = secondsSince(start);
+        listing_done = true;
+        jobs.close();
+    });
+
+    // ---- Stage 2: decode + preprocess ----
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            IngestJob job;
+            vector<uchar> bytes;  // file contents, reused across jobs
+            for (;;) {
+                // Take a buffer before the job, so whichever row the
+                // collector is waiting on is never stuck without one
+                IngestResult result;
+                if (!free_buffers.pop(result.features)) break;
+                if (!jobs.pop(job)) break;
+                try {
+                    result.row = job.row;
+                    result.name = fs::path(job.path).filename().string();
+                    {
+                        // Per-image latency, not counting queue waits
+                        PROFILE_SCOPE("image");
+                        if (cache) {
+                            cachedImageToRow(job.path, result.features.data(), params, *cache, bytes);
+                        } else {
+                            imageToRow(job.path, result.features.data(), params);
+                        }
+                    }
+                    PROFILE_COUNT("images", 1);
+                    decoded++;
+                    if (!results.push(std::move(result))) break;
+                } catch (...) {
+                    fail(current_exception());
+                    break;
+                }
+            }
+            if (--running_workers == 0) {
+                decode_seconds = secondsSince(start);
+                results.close();
+            }
+        });
+    }
+
+    // ---- Stage 3: hand rows to the consumer in listing order ----
+    // Rows that finish early wait in `ready`, still in their pool buffers,
+    // until the rows before them arrive; the pool bounds how far ahead
+    // they can get.
+    map<size_t, IngestResult> ready;
+    size_t collected = 0;
+    auto last_report = start;
+    IngestResult result;
+    while (results.pop(result)) {
+        size_t row = result.row;
+        ready.emplace(row, std::move(result));
+
+        bool stopped = false;
+        for (auto it = ready.begin(); it != ready.end() && it->first == collected; it = ready.begin()) {
+            try {
+                PROFILE_SCOPE("consume");
+                consume(StreamedRow{it->first, it->second.name, it->second.features.data(),
+                                    listed, listing_done});
+            } catch (...) {
+                fail(current_exception());
+                stopped = true;
+                break;
+            }
+            free_buffers.push(std::move(it->second.features));
+            ready.erase(it);
+            collected++;
+        }
+        if (stopped) break;
+
+        auto now = chrono::steady_clock::now();
+        if (now - last_report >= chrono::seconds(1)) {
+            last_report = now;
+            double elapsed = secondsSince(start);
+            log << "  listed " << listed << ", decoded " << decoded
+                << " (" << fixed << setprecision(1) << perSecond(decoded, elapsed)
+                << " images/s), collected " << collected << endl;
+        }
+    }
+
+    lister.join();
+    for (auto& w : workers) w.join();
+    if (error) rethrow_exception(error);
+
+    double total_seconds = secondsSince(start);
+    log << fixed << setprecision(2)
+        << "  list:    " << listed << " files in " << list_seconds << " s ("
+        << perSecond(listed, list_seconds) << " files/s)" << endl
+        << "  decode:  " << decoded << " images in " << decode_seconds << " s ("
+        << perSecond(decoded, decode_seconds) << " images/s, " << threads << " threads)" << endl
+        << "  collect: " << collected << " rows in " << total_seconds << " s" << endl;
+    if (cache) {
+        log << "  cache:   " << cache->hits() << " hits, " << cache->misses() << " misses" << endl;
+    }
+    return true;
+}
+
+void ingestDirectory(const string& directory_path, const PreprocessParams& params,
+                     FeatureMatrix& X, vector<string>& names, int threads,
+                     FeatureCache* cache)
+{
+    size_t cols = (size_t)params.image_size * params.image_size;
+    if (X.rows == 0) X.cols = cols;
+    if (X.cols != cols) {
+        throw runtime_error("Error: feature matrix has " + to_string(X.cols) +
+                            " columns but images produce " + to_string(cols));
+    }
+
+    // Rows arrive in listing order, so each one is appended
+    bool reserved = false;
+    auto store = [&](const StreamedRow& r) {
+        // Size the matrix once the final count is known; grow until then
+        if (!reserved && r.listing_done) {
+            X.data.reserve((X.rows + r.listed - r.row) * cols);
+            names.reserve(names.size() + r.listed - r.row);
+            reserved = true;
+        }
+
+        size_t row = X.rows;
+        X.resize(row + 1, cols);
+        copy(r.features, r.features + cols, X.row(row));
+        names.push_back(r.name);
+    };
+
+    streamDirectory(directory_path, params, store, threads, cache, cout);
+}
@@ -0,0 +1,51 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <iostream>
+#include "image_processor.h"
+#include "feature_matrix.h"
+#include "feature_cache.h"
+
+// One preprocessed image handed from the pipeline to its consumer
+struct StreamedRow {
+    size_t row;                 // position in directory listing order
+    const std::string& name;    // file name without the directory
+    const feature_t* features;  // image_size^2 values, valid only during the call
+    size_t listed;              // files listed so far
+    bool listing_done;          // listed is the final count
+};
+
+typedef std::function<void(const StreamedRow&)> RowConsumer;
+
+// Decode and preprocess every regular file in a directory as a pipeline:
+//   list    - one thread walks the directory and queues (row, path) jobs
+//   decode  - `threads` workers run imageToRow on each job into a buffer
+//             from a fixed pool, so steady state allocates nothing
+//   consume - the calling thread passes each row to `consume` in listing
+//             order and returns its buffer to the pool
+// The stages are joined by bounded queues and the buffer pool, so at most
+// about 3 images per worker are in flight (including rows that finished
+// early and wait for an earlier one) no matter how large the folder is.
+// Progress and per-stage throughput go to `log`. threads <= 0 uses one
+// worker per core. An image that fails to load, or an exception from
+// `consume`, stops the pipeline and is rethrown here.
+//
+// With a cache, workers read each file's bytes, look the content hash up
+// and only decode on a miss (from the bytes already read). The cache
+// flushes its new rows in batches; the caller cache->save()s the rest.
+//
+// Returns false (after printing an error) if the directory does not exist.
+bool streamDirectory(const std::string& directory_path, const PreprocessParams& params,
+                     const RowConsumer& consume, int threads = 0,
+                     FeatureCache* cache = nullptr, std::ostream& log = std::cout);
+
+// streamDirectory into a feature matrix: rows are appended to X (and file
+// names to names) in directory listing order.
+void ingestDirectory(const std::string& directory_path, const PreprocessParams& params,
+                     FeatureMatrix& X, std::vector<std::string>& names,
+                     int threads = 0, FeatureCache* cache = nullptr);
+
+#endif
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include "unix_socket.h"
+
+namespace fs = std::filesystem;
+using namespace std;
+
+// Load generator for image_processor --serve. Each client thread holds one
+// connection and sends requests back to back (closed loop), cycling through
+// the given images, and records the round-trip latency of every request.
+//
+//   loadgen SOCKET PATH... [--clients N] [--requests N] [--bytes]
+//
+// PATH is an image or a directory of images. --bytes sends the encoded file
+// contents instead of the path, for servers that cannot see the files.
+
+struct ClientStats {
+    vector<double> latency_us;
+    size_t errors = 0;
+    double server_us = 0, batch = 0;    // sums over successful replies
+    string first_error;
+};
+
+static vector<char> readFile(const string& path)
+{
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Error: could not read " + path);
+    return vector<char>(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+static void runClient(const string& socket_path, const vector<string>& paths,
+                      const vector<vector<char>>& contents, size_t first, size_t count,
+                      ClientStats& stats)
+{
+    int fd = connectUnix(socket_path);
+    SocketReader in(fd);
+    string reply;
+    stats.latency_us.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        size_t k = (first + i) % paths.size();
+        auto start = chrono::steady_clock::now();
+
+        bool sent;
+        if (contents.empty()) {
+            sent = writeAll(fd, "PATH " + paths[k] + "\n");
+        } else {
+            sent = writeAll(fd, "BYTES " + to_string(contents[k].size()) + "\n") &&
+                   writeAll(fd, contents[k].data(), contents[k].size());
+        }
+        if (!sent || !in.readLine(reply)) {
+            closeSocket(fd);
+            throw runtime_error("Error: server closed the connection");
+        }
+
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        if (reply.compare(0, 3, "OK ") == 0) {
+            // OK <score> <label> <tree_label> <batch> <queue_us> <server_us>
+            istringstream fields(reply.substr(3));
+            double score, batch, queue_us, server_us;
+            int label, tree_label;
+            fields >> score >> label >> tree_label >> batch >> queue_us >> server_us;
+            stats.latency_us.push_back(us);
+            stats.server_us += server_us;
+            stats.batch += batch;
+        } else {
+            if (stats.errors++ == 0) stats.first_error = reply;
+        }
+    }
+    closeSocket(fd);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0.0;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[min(max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        const string usage = "Usage: loadgen SOCKET PATH... [--clients N] [--requests N] [--bytes]";
+        string socket_path;
+        vector<string> inputs;
+        int clients = 4;
+        size_t requests = 1000;
+        bool send_bytes = false;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--clients" && has_value) clients = max(1, stoi(argv[++i]));
+            else if (arg == "--requests" && has_value) requests = stoul(argv[++i]);
+            else if (arg == "--bytes") send_bytes = true;
+            else if (arg.compare(0, 2, "--") == 0) throw runtime_error("Unknown option: " + arg + "\n" + usage);
+            else if (socket_path.empty()) socket_path = arg;
+            else inputs.push_back(arg);
+        }
+        if (socket_path.empty() || inputs.empty()) throw runtime_error(usage);
+
+        // Absolute paths, since the server resolves them from its own directory
+        vector<string> paths;
+        for (const string& input : inputs) {
+            if (fs::is_directory(input)) {
+                for (const auto& entry : fs::directory_iterator(input)) {
+                    if (fs::is_regular_file(entry.status())) paths.push_back(fs::absolute(entry.path()).string());
+                }
+            } else {
+                paths.push_back(fs::absolute(input).string());
+            }
+        }
+        if (paths.empty()) throw runtime_error("Error: no images found");
+        sort(paths.begin(), paths.end());
+
+        vector<vector<char>> contents;
+        if (send_bytes) {
+            for (const string& p : paths) contents.push_back(readFile(p));
+        }
+
+        cout << "Sending " << requests << " requests from " << clients << " clients ("
+             << paths.size() << " images, " << (send_bytes ? "bytes" : "paths") << ")" << endl;
+
+        // Split the requests evenly; each client starts at a different image
+        vector<ClientStats> stats(clients);
+        vector<thread> threads;
+        atomic<int> failed{0};
+        string failure;
+        auto start = chrono::steady_clock::now();
+        for (int c = 0; c < clients; c++) {
+            size_t count = requests / clients + ((size_t)c < requests % clients ? 1 : 0);
+            threads.emplace_back([&, c, count] {
+                try {
+                    runClient(socket_path, paths, contents, c * paths.size() / clients, count, stats[c]);
+                } catch (const exception& e) {
+                    if (failed++ == 0) failure = e.what();
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (failed) throw runtime_error(failure);
+
+        vector<double> latency;
+        size_t errors = 0;
+        double server_us = 0, batch = 0;
+        for (const ClientStats& s : stats) {
+            latency.insert(latency.end(), s.latency_us.begin(), s.latency_us.end());
+            errors += s.errors;
+            server_us += s.server_us;
+            batch += s.batch;
+            if (s.errors > 0) cerr << "Server error: " << s.first_error << endl;
+        }
+        sort(latency.begin(), latency.end());
+        size_t ok = latency.size();
+
+        cout << fixed << setprecision(1)
+             << "Completed:   " << ok << " ok, " << errors << " errors in " << setprecision(3) << seconds << " s" << endl
+             << setprecision(1)
+             << "Throughput:  " << (seconds > 0 ? (ok + errors) / seconds : 0.0) << " requests/s" << endl
+             << "Latency us:  p50 " << percentile(latency, 50) << "  p90 " << percentile(latency, 90)
+             << "  p99 " << percentile(latency, 99) << "  max " << (ok ? latency.back() : 0.0) << endl
+             << "Server side: " << (ok ? server_us / ok : 0.0) << " us mean, "
+             << setprecision(2) << (ok ? batch / ok : 0.0) << " rows per scoring batch" << endl;
+        return errors == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
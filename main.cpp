@@ -3,30 +3,29 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
+#include <chrono>
+#include <limits>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include "image_processor.h"
+#include "ingest.h"
 #include "decision_tree.h"
+#include "centroid_model.h"
+#include "centroid_scorer.h"
+#include "evaluation.h"
+#include "process_stats.h"
+#include "inference_server.h"
+#include "random_forest.h"
+#include "profiler.h"
+#include "enhance.h"
 
 namespace fs = std::filesystem;
 using namespace std;
 
-void addData(string directory_path, int label, vector<vector<double>> &X, vector<string> &y){
-    if (!fs::exists(directory_path) || !fs::is_directory(directory_path)) {
-        std::cerr << "Error: Directory '" << directory_path << "' does not exist or is not a directory." << std::endl;
-        return ;
-    }
-        
-    int cnt = 0;
-    for (const auto& entry : fs::directory_iterator(directory_path)) {
-        cnt++;
-        if(cnt % 200 == 0) cout << "Processed " << cnt << " files..." << endl;
-        if (fs::is_regular_file(entry.status())) {
-            string fname = entry.path().string();
-            vector<vector<double>> img = imageToVector(fname);
-            vector<double> imgf = flatten(img);
-            X.push_back(imgf);
-            y.push_back(entry.path().filename().string());
-        }
-    }
+void addData(string directory_path, int label, const PreprocessParams& params,
+             FeatureMatrix &X, vector<string> &y, FeatureCache* cache){
+    ingestDirectory(directory_path, params, X, y, 0, cache);
 }
 vector<double> average(vector<vector<double>> &X){
     vector<double> re(X[0].size());
@@ -41,153 +40,334 @@ vector<double> average(vector<vector<double>> &X){
     return re;
 }
 
-double dot(vector<double>& a, vector<double> &b){
-    assert(a.size() == b.size());
-
-    int n = a.size();
-    double re = 0;
-    for(int i = 0; i < n; i++) re += a[i] * b[i];
-
+// JSON string body for a file name (quotes, backslashes and control chars)
+static string jsonEscape(const string& s){
+    string re;
+    for(unsigned char c : s){
+        if(c == '"' || c == '\\') { re += '\\'; re += (char)c; }
+        else if(c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            re += buf;
+        }
+        else re += (char)c;
+    }
     return re;
 }
 
-bool query(vector<double> &x, vector<double>& norm, vector<double>& pos){
-    return dot(x, norm) < dot(x, pos);
+// CSV field, quoted only when it has to be
+static string csvField(const string& s){
+    if(s.find_first_of(",\"\r\n") == string::npos) return s;
+    string re = "\"";
+    for(char c : s){
+        if(c == '"') re += '"';
+        re += c;
+    }
+    return re + "\"";
 }
 
-// Apply normalization using saved means and stdevs (z-score)
-void normalizeWithParams(vector<vector<double>>& X, const vector<double>& means, const vector<double>& stdevs) {
-    for (auto& sample : X) {
-        for (size_t j = 0; j < sample.size(); j++) {
-            if (stdevs[j] > 1e-10) {
-                sample[j] = (sample[j] - means[j]) / stdevs[j];
-            } else {
-                sample[j] = 0.0;
-            }
+// Streaming mode: score each image as soon as it is preprocessed and write
+// one result per line, in directory listing order. Nothing is kept per
+// image, so memory stays flat however large the directory is. Results go to out_path
+// ("-" for stdout); progress and the summary go to stderr.
+int runStream(const CentroidModel& model, const CentroidScorer& scorer, const string& dir,
+              double threshold, const string& format, const string& out_path){
+    ofstream file;
+    if(out_path != "-"){
+        file.open(out_path);
+        if(!file) throw runtime_error("Error: could not open " + out_path + " for writing");
+    }
+    ostream& out = out_path == "-" ? cout : file;
+    bool jsonl = format == "jsonl";
+    if(!jsonl) out << "index,file,score,prediction\n";
+    out << setprecision(numeric_limits<double>::max_digits10);
+
+    size_t cols = (size_t)model.preprocess.image_size * model.preprocess.image_size;
+    if(cols != model.num_features){
+        throw runtime_error("Error: model expects " + to_string(model.num_features) +
+                            " features but images produce " + to_string(cols));
+    }
+
+    auto start = chrono::steady_clock::now();
+    double first_result = -1;
+    size_t scored = 0, positive = 0;
+    auto emit = [&](const StreamedRow& r){
+        PROFILE_SCOPE("score");
+        double score = scorer.score(r.features);
+        int prediction = score > threshold ? 1 : 0;
+        if(jsonl){
+            out << "{\"index\":" << r.row << ",\"file\":\"" << jsonEscape(r.name)
+                << "\",\"score\":" << score << ",\"prediction\":" << prediction << "}\n";
+        } else {
+            out << r.row << ',' << csvField(r.name) << ',' << score << ',' << prediction << '\n';
+        }
+        if(first_result < 0){
+            out.flush();
+            first_result = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        scored++;
+        positive += prediction;
+    };
+
+    if(!streamDirectory(dir, model.preprocess, emit, 0, nullptr, cerr)) return 1;
+    out.flush();
+    if(!out) throw runtime_error("Error: failed writing results to " + out_path);
+
+    double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << fixed << setprecision(3)
+         << "Scored " << scored << " images (" << positive << " above threshold "
+         << threshold << ")" << endl
+         << "Time to first result: " << (first_result < 0 ? 0.0 : first_result) << " s" << endl
+         << "Total time:           " << total << " s ("
+         << setprecision(1) << (total > 0 ? scored / total : 0.0) << " images/s)" << endl
+         << "Peak RSS:             " << peakRssBytes() / (1024.0 * 1024.0) << " MB" << endl;
+    return 0;
+}
+
+// Reduced-resolution decoding (PreprocessParams::reduced_decode) against
+// full decoding of the same images: throughput, drift of the preprocessed
+// features from the full-decode rows, and the centroid classifier's ROC
+// AUC plus its accuracy and changed predictions at the threshold that is
+// optimal for full decoding
+int runDecodeReport(const CentroidModel& model, const CentroidScorer& scorer, const string& dir){
+    struct Setting {
+        uint32_t reduced_decode;
+        double images_per_second, mean_drift, max_drift, accuracy, roc_auc;
+        size_t flips;
+    };
+    vector<Setting> settings;
+    FeatureMatrix full;
+    vector<string> full_names;
+    vector<int> labels, full_predictions;
+    double threshold = 0;
+
+    for(uint32_t reduced : {0u, 4u, 2u, 1u}){
+        PreprocessParams params = model.preprocess;
+        params.reduced_decode = reduced;
+        FeatureMatrix X;
+        vector<string> names;
+        auto start = chrono::steady_clock::now();
+        ingestDirectory(dir, params, X, names);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(X.rows == 0){
+            cerr << "Error: no images found in " << dir << endl;
+            return 1;
+        }
+
+        vector<double> scores(X.rows);
+        for(size_t i = 0; i < X.rows; i++) scores[i] = scorer.score(X.row(i));
+        if(reduced == 0){
+            for(const string& name : names) labels.push_back(labelFromName(name));
+            threshold = sweepThresholds(scores, labels).best.threshold;
+            for(double score : scores) full_predictions.push_back(score > threshold ? 1 : 0);
+            full = X;
+            full_names = names;
+        } else if(names != full_names){
+            throw runtime_error("Error: " + dir + " changed during the decode report");
+        }
+
+        Setting r = {reduced, seconds > 0 ? X.rows / seconds : 0.0, 0, 0, 0, 0, 0};
+        double drift_sum = 0;
+        for(size_t i = 0; i < X.data.size(); i++){
+            double d = fabs((double)X.data[i] - full.data[i]);
+            drift_sum += d;
+            r.max_drift = max(r.max_drift, d);
         }
+        r.mean_drift = drift_sum / X.data.size();
+
+        size_t correct = 0, labelled = 0;
+        for(size_t i = 0; i < X.rows; i++){
+            int prediction = scores[i] > threshold ? 1 : 0;
+            r.flips += prediction != full_predictions[i];
+            if(labels[i] < 0) continue;
+            labelled++;
+            correct += prediction == labels[i];
+        }
+        r.accuracy = labelled ? (double)correct / labelled : 0.0;
+        r.roc_auc = sweepThresholds(scores, labels).roc_auc;
+        settings.push_back(r);
+    }
+
+    cout << "\n=== REDUCED DECODE REPORT (" << full.rows << " images in " << dir
+         << ", threshold " << fixed << setprecision(4) << threshold << ") ===" << endl;
+    cout << "reduced_decode  images/s  mean|drift|  max|drift|  accuracy  ROC AUC  changed" << endl;
+    for(const Setting& r : settings){
+        cout << setw(14) << (r.reduced_decode ? to_string(r.reduced_decode) : string("full"))
+             << setw(10) << setprecision(1) << r.images_per_second
+             << setw(13) << setprecision(4) << r.mean_drift
+             << setw(12) << r.max_drift
+             << setw(9) << setprecision(2) << 100 * r.accuracy << "%"
+             << setw(9) << setprecision(4) << r.roc_auc
+             << setw(9) << r.flips << endl;
     }
+    cout << "(JPEGs decode at the smallest 1/2, 1/4 or 1/8 scale keeping the shorter side\n"
+            " >= reduced_decode * " << model.preprocess.image_size
+         << " pixels; other formats always decode in full)" << endl;
+    return 0;
 }
 
-vector<cv::Mat> read_images(const string& directory_path){
-    if (!fs::exists(directory_path) || !fs::is_directory(directory_path)) {
-        std::cerr << "Error: Directory '" << directory_path << "' does not exist or is not a directory." << std::endl;
-        return vector<cv::Mat>();
+// Accuracy and throughput of a random forest over the same images
+void evaluateForest(const string& path, const FeatureMatrix& X, const vector<string>& fname){
+    RandomForest forest;
+    if (!forest.load(path)) throw runtime_error("Error: could not load forest " + path);
+    if (forest.feature_span() > X.cols) {
+        throw runtime_error("Error: forest uses feature " + to_string(forest.feature_span() - 1) +
+                            " but images produce " + to_string(X.cols));
     }
-    
-    vector<cv::Mat> re;
-    int cnt = 0;
-    for (const auto& entry : fs::directory_iterator(directory_path)) {
-        cnt++;
-        if(cnt % 200 == 0) cout << cnt << endl;
-        if (fs::is_regular_file(entry.status())) {
-            string fname = entry.path().string();
-            cv::Mat image = cv::imread(fname, cv::IMREAD_GRAYSCALE);
-            re.push_back(image);
-        }
+
+    // Trees compare doubles; widen the rows once
+    vector<double> rows(X.data.begin(), X.data.end());
+    vector<int> predicted(X.rows);
+    auto start = chrono::steady_clock::now();
+    {
+        PROFILE_SCOPE("forest_predict");
+        forest.predict_batch(rows.data(), X.rows, X.cols, predicted.data(), 0);
     }
-    return re;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int correct = 0, labelled = 0;
+    for(size_t i = 0; i < X.rows; i++){
+        int label = labelFromName(fname[i]);
+        if (label < 0) continue;
+        labelled++;
+        correct += predicted[i] == label;
+    }
+    cout << "\n=== RANDOM FOREST (" << forest.size() << " trees) ===" << endl;
+    cout << "Accuracy:    " << fixed << setprecision(2)
+         << (labelled ? 100.0 * correct / labelled : 0.0) << "% of " << labelled << " labelled images" << endl;
+    cout << "Throughput:  " << setprecision(0) << (seconds > 0 ? X.rows / seconds : 0.0) << " images/s" << endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        // Load weights (class averages)
-        ifstream is("weights.txt");
-        if (!is) {
-            throw runtime_error("Error: weights.txt not found! Run trainer first.");
+        // --no-cache: decode every image even if its features are cached
+        // --stream DIR: score DIR image by image and write results as they
+        //   finish, instead of the whole-folder evaluation below
+        // --serve SOCKET: keep the model loaded and score requests sent over
+        //   a Unix socket (see inference_server.h)
+        // --forest FILE: also evaluate a random forest from trainer --forest
+        // --decode-report: compare reduced-resolution and full decoding of
+        //   ./test instead of the evaluation below
+        // --filter sharpen|clahe|unsharp: enhancement applied to
+        //   ./test_filter after the evaluation (default sharpen)
+        // --profile: print per-stage timings, counters and peak RSS to
+        //   stderr at exit; --trace FILE also writes a Chrome trace
+        const string usage = "Usage: image_processor [--no-cache] [--forest FILE] [--filter sharpen|clahe|unsharp]\n"
+                             "       image_processor --decode-report\n"
+                             "       image_processor --stream DIR [--threshold T] [--format csv|jsonl] [--out FILE]\n"
+                             "       image_processor --serve SOCKET [--threshold T] [--tree FILE] [--max-batch N]\n"
+                             "                              [--max-connections N]\n"
+                             "       (any mode) [--profile] [--trace FILE]";
+        bool use_cache = true, decode_report = false, profile = false;
+        string stream_dir, format = "csv", out_path = "-", trace_path;
+        string serve_socket, tree_path, forest_path, filter_name = "sharpen";
+        size_t max_batch = 64, max_connections = 256;
+        double threshold = 0.0;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--no-cache") use_cache = false;
+            else if (arg == "--decode-report") decode_report = true;
+            else if (arg == "--profile") profile = true;
+            else if (arg == "--trace" && has_value) trace_path = argv[++i];
+            else if (arg == "--stream" && has_value) stream_dir = argv[++i];
+            else if (arg == "--threshold" && has_value) threshold = stod(argv[++i]);
+            else if (arg == "--format" && has_value) format = argv[++i];
+            else if (arg == "--out" && has_value) out_path = argv[++i];
+            else if (arg == "--serve" && has_value) serve_socket = argv[++i];
+            else if (arg == "--tree" && has_value) tree_path = argv[++i];
+            else if (arg == "--max-batch" && has_value) max_batch = stoul(argv[++i]);
+            else if (arg == "--max-connections" && has_value) max_connections = stoul(argv[++i]);
+            else if (arg == "--forest" && has_value) forest_path = argv[++i];
+            else if (arg == "--filter" && has_value) filter_name = argv[++i];
+            else throw runtime_error("Unknown option: " + arg + "\n" + usage);
         }
-        vector<double> data;
-        double x;
-        while(is >> x) data.push_back(x);
-        is.close();
-
-        vector<double> norm, pos;
-        for(int i = 0; i < data.size() /2; i++){
-            norm.push_back(data[i]);
-        }
-        for(int i = data.size() / 2; i < data.size(); i++){
-            pos.push_back(data[i]);
+        if (format != "csv" && format != "jsonl") {
+            throw runtime_error("Unknown format: " + format + "\n" + usage);
         }
-        
-        // Load normalization parameters
-        cout << "Loading normalization parameters..." << endl;
-        ifstream norm_is("normalization.txt");
-        if (!norm_is) {
-            throw runtime_error("Error: normalization.txt not found! Run trainer first.");
+        parseEnhanceFilter(filter_name);  // reject a bad name before any work
+        ProfileSession profile_session(profile, trace_path);
+
+        // Load the model bundle (class averages + normalization parameters)
+        bool quiet = !stream_dir.empty() || !serve_socket.empty();
+        (quiet ? cerr : cout) << "Loading model..." << endl;
+        CentroidModel model;
+        try {
+            model.load("model.bin");
+        } catch (const std::exception& e) {
+            throw runtime_error(string(e.what()) + "\nRun trainer first.");
         }
-        int num_features;
-        norm_is >> num_features;
-        vector<double> means(num_features), stdevs(num_features);
-        for (size_t i = 0; i < means.size(); i++) {
-            norm_is >> means[i];
+        // Normalization is folded into the scoring weights, so raw
+        // preprocessed rows are scored directly
+        if (!serve_socket.empty()) {
+            DecisionTree tree;
+            if (!tree_path.empty() && !tree.load(tree_path)) return 1;
+            ServerOptions options;
+            options.socket_path = serve_socket;
+            options.threshold = threshold;
+            options.max_batch = max_batch;
+            options.max_connections = max_connections;
+            runInferenceServer(model, tree_path.empty() ? nullptr : &tree, options);
+            return 0;
         }
-        for (size_t i = 0; i < stdevs.size(); i++) {
-            norm_is >> stdevs[i];
+        CentroidScorer scorer(model);
+        if (!stream_dir.empty()) {
+            return runStream(model, scorer, stream_dir, threshold, format, out_path);
         }
-        norm_is.close();
+        cout << "Scoring kernel: " << scorer.kernel() << endl;
+        if (decode_report) return runDecodeReport(model, scorer, "./test");
 
-        vector<vector<double>> X;
+        FeatureMatrix X;
         vector<string> fname;
         string dir = "./test";
-        addData(dir, -1, X, fname);
+        FeatureCache cache("feature_cache", model.preprocess);
+        addData(dir, -1, model.preprocess, X, fname, use_cache ? &cache : nullptr);
+        if (use_cache) cache.save();
         
-        cout << "Loaded " << X.size() << " test images" << endl;
-        if (X.empty()) {
+        cout << "Loaded " << X.rows << " test images" << endl;
+        if (X.rows == 0) {
             cout << "ERROR: No test images found in " << dir << endl;
             return 1;
         }
+        if (X.cols != model.num_features) {
+            throw runtime_error("Error: model expects " + to_string(model.num_features) +
+                                " features but images produce " + to_string(X.cols));
+        }
         
-        // Apply the same normalization used during training
-        cout << "Normalizing test data..." << endl;
-        normalizeWithParams(X, means, stdevs);
-        
-        // Track metrics for confusion matrix
-        int TP = 0, FP = 0, TN = 0, FN = 0;
-        
-        // Find optimal threshold by testing multiple values
-        double best_accuracy = 0;
-        double best_threshold = 0;
+        // Score and label every image once
+        vector<double> scores(X.rows);
+        vector<int> labels(X.rows);
+        for(size_t i = 0; i < X.rows; i++){
+            PROFILE_SCOPE("score");
+            scores[i] = scorer.score(X.row(i));
+            labels[i] = labelFromName(fname[i]);
+        }
         
-        // Try different thresholds with finer granularity
-        for (double threshold = -2.0; threshold <= 2.0; threshold += 0.01) {
-            int tp = 0, fp = 0, tn = 0, fn = 0;
-            
-            for(size_t i = 0; i < X.size(); i++){
-                double score_norm = dot(X[i], norm);
-                double score_pos = dot(X[i], pos);
-                bool predicted_TB = (score_pos - score_norm) > threshold;
-                
-                bool is_actually_TB = (fname[i].find("Tuberculosis") != string::npos);
-                bool is_actually_Normal = (fname[i].find("Normal") != string::npos);
-                
-                if(predicted_TB) {
-                    if(is_actually_TB) tp++;
-                    else if(is_actually_Normal) fp++;
-                } else {
-                    if(is_actually_Normal) tn++;
-                    else if(is_actually_TB) fn++;
-                }
-            }
-            
-            // Calculate accuracy
-            double accuracy = (double)(tp + tn) / X.size();
-            
-            if (accuracy > best_accuracy) {
-                best_accuracy = accuracy;
-                best_threshold = threshold;
-                TP = tp;
-                FP = fp;
-                TN = tn;
-                FN = fn;
-            }
+        // Find the optimal threshold with one sorted sweep, and write the
+        // ROC/PR curve it passes through
+        SweepResult sweep;
+        {
+            PROFILE_SCOPE("threshold_sweep");
+            sweep = sweepThresholds(scores, labels);
         }
+        {
+            PROFILE_SCOPE("write_curves");
+            writeCurves(sweep, "roc_pr_curve.csv", "auc.txt");
+        }
+        
+        double best_accuracy = sweep.best.accuracy;
+        double best_threshold = sweep.best.threshold;
+        int TP = sweep.best.tp, FP = sweep.best.fp, TN = sweep.best.tn, FN = sweep.best.fn;
         
-        cout << "Optimal threshold found: " << fixed << setprecision(2) << best_threshold << " (Accuracy: " << best_accuracy * 100 << "%)" << endl;
+        cout << "Optimal threshold found: " << fixed << setprecision(4) << best_threshold
+             << setprecision(2) << " (Accuracy: " << best_accuracy * 100 << "%)" << endl;
+        cout << "ROC AUC: " << setprecision(4) << sweep.roc_auc
+             << "  Average precision: " << sweep.average_precision
+             << " (curve written to roc_pr_curve.csv, areas to auc.txt)" << endl;
         cout << "\nThe following images in " << dir << " are likely positive for tuberculosis: " << endl;
         cout << "==========================================" << endl;
-        for(size_t i = 0 ; i < X.size(); i++){
-            double score_norm = dot(X[i], norm);
-            double score_pos = dot(X[i], pos);
-            bool predicted_TB = (score_pos - score_norm) > best_threshold;
+        for(size_t i = 0 ; i < X.rows; i++){
+            bool predicted_TB = scores[i] > best_threshold;
             
             if(predicted_TB) {
                 cout << fname[i] << endl;
@@ -224,17 +404,15 @@ int main() {
             cout << "False Negatives (FN):       " << FN << " (Missed TB cases)" << endl;
         }
         
-        auto imgs = read_images("./test_filter");
-        cv::Mat kernel = (cv::Mat_<float>(3,3) << -1, -1, -1,
-                                         -1, 9, -1,
-                                          -1, -1, -1);
-
-        int ind = 0;
-        for(auto &image : imgs) {
-            cout << ind << endl;
-            cv::Mat sharpened_image;
-            cv::filter2D(image, sharpened_image, image.depth(), kernel);
-            cv::imwrite( "./filter_out/" + to_string(ind++) + ".png", sharpened_image);
+        if (!forest_path.empty()) evaluateForest(forest_path, X, fname);
+
+        // Enhanced copies of ./test_filter, written to ./filter_out/<n>.png
+        if (fs::exists("./test_filter")) {
+            cout << "\nEnhancing ./test_filter (" << filter_name << ")..." << endl;
+            EnhanceOptions enhance;
+            enhance.filter = parseEnhanceFilter(filter_name);
+            EnhanceStats enhanced;
+            enhanceDirectory("./test_filter", "./filter_out", enhance, enhanced);
         }
         
     } catch (const std::exception& e) {
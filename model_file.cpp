@@ -0,0 +1,205 @@
+#include "model_file.h"
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char MODEL_MAGIC[8] = {'T', 'B', 'M', 'O', 'D', 'E', 'L', '\0'};
+
+uint64_t fnv1a64(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// ============ MappedFile ============
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        bytes = other.bytes;
+        length = other.length;
+        other.bytes = nullptr;
+        other.length = 0;
+#ifdef _WIN32
+        file_handle = other.file_handle;
+        map_handle = other.map_handle;
+        other.file_handle = nullptr;
+        other.map_handle = nullptr;
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const string& filename) {
+    close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle = file;
+    map_handle = mapping;
+    bytes = (const unsigned char*)view;
+    length = (size_t)file_size.QuadPart;
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes) UnmapViewOfFile(bytes);
+    if (map_handle) CloseHandle((HANDLE)map_handle);
+    if (file_handle) CloseHandle((HANDLE)file_handle);
+    bytes = nullptr;
+    length = 0;
+    map_handle = file_handle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // the mapping keeps the file alive
+    if (view == MAP_FAILED) return false;
+
+    bytes = (const unsigned char*)view;
+    length = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes) munmap((void*)bytes, length);
+    bytes = nullptr;
+    length = 0;
+}
+
+#endif
+
+// ============ Model files ============
+
+void writeModelFile(const string& filename, ModelKind kind,
+                    const void* payload, size_t payload_size)
+{
+    ModelFileWriter writer(filename, kind);
+    writer.write(payload, payload_size);
+    writer.finish();
+}
+
+ModelFileWriter::ModelFileWriter(const string& filename, ModelKind kind)
+    : filename(filename), kind(kind), out(filename, ios::binary | ios::trunc)
+{
+    if (!out) {
+        throw runtime_error("Error: cannot open file for writing: " + filename);
+    }
+    ModelHeader placeholder = {};
+    out.write((const char*)&placeholder, sizeof(placeholder));
+}
+
+void ModelFileWriter::write(const void* data, size_t size) {
+    checksum = fnv1a64(data, size, checksum);
+    payload_size += size;
+    out.write((const char*)data, size);
+}
+
+void ModelFileWriter::finish() {
+    ModelHeader header;
+    memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version = MODEL_FORMAT_VERSION;
+    header.kind = kind;
+    header.payload_size = payload_size;
+    header.checksum = checksum;
+
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.close();
+    if (!out) {
+        throw runtime_error("Error: failed writing model file: " + filename);
+    }
+}
+
+const unsigned char* openModelFile(MappedFile& file, const string& filename,
+                                   ModelKind kind, size_t& payload_size)
+{
+    if (!file.open(filename)) {
+        throw runtime_error("Error: cannot map model file: " + filename);
+    }
+    if (file.size() < sizeof(ModelHeader)) {
+        throw runtime_error("Error: model file is truncated: " + filename);
+    }
+
+    const ModelHeader* header = (const ModelHeader*)file.data();
+    if (memcmp(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0) {
+        throw runtime_error("Error: not a model file: " + filename);
+    }
+    if (header->version != MODEL_FORMAT_VERSION) {
+        throw runtime_error("Error: unsupported model format version " +
+                            to_string(header->version) + ": " + filename);
+    }
+    if (header->kind != kind) {
+        throw runtime_error("Error: model file holds a different kind of model: " + filename);
+    }
+    if (header->payload_size != file.size() - sizeof(ModelHeader)) {
+        throw runtime_error("Error: model file size does not match its header: " + filename);
+    }
+
+    const unsigned char* payload = file.data() + sizeof(ModelHeader);
+    payload_size = (size_t)header->payload_size;
+    if (fnv1a64(payload, payload_size) != header->checksum) {
+        throw runtime_error("Error: model file checksum mismatch: " + filename);
+    }
+
+    return payload;
+}
@@ -0,0 +1,93 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <string>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+
+// Binary model files share one layout: a fixed ModelHeader followed by a
+// kind-specific payload. The payload is plain arrays meant to be used in
+// place from a read-only mapping, so opening a model does no parsing and
+// no allocation beyond the mapping itself. Multi-byte values are stored in
+// the host's (little-endian) byte order.
+
+enum ModelKind : uint32_t {
+    MODEL_DECISION_TREE = 1,
+    MODEL_CENTROID = 2,
+    MODEL_FEATURE_CACHE = 3,
+    MODEL_RANDOM_FOREST = 4,
+    MODEL_FEATURE_BINS = 5,
+};
+
+static const uint32_t MODEL_FORMAT_VERSION = 1;
+
+struct ModelHeader {
+    char magic[8];          // "TBMODEL\0"
+    uint32_t version;       // MODEL_FORMAT_VERSION
+    uint32_t kind;          // ModelKind
+    uint64_t payload_size;  // bytes following the header
+    uint64_t checksum;      // FNV-1a 64 of the payload
+};
+
+// 64-bit FNV-1a hash
+uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Returns false (and stays closed) if the file cannot be mapped
+    bool open(const std::string& filename);
+    void close();
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+    bool is_open() const { return bytes != nullptr; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* map_handle = nullptr;
+#endif
+};
+
+// Write header + payload. Throws std::runtime_error on I/O failure.
+void writeModelFile(const std::string& filename, ModelKind kind,
+                    const void* payload, size_t payload_size);
+
+// writeModelFile for a payload produced piece by piece, so it never has to
+// be held in memory whole: the header goes in last, once the size and
+// checksum are known. Until finish() the file is not a valid model file.
+// Throws std::runtime_error on I/O failure.
+class ModelFileWriter {
+public:
+    ModelFileWriter(const std::string& filename, ModelKind kind);
+
+    void write(const void* data, size_t size);
+    void finish();
+
+private:
+    std::string filename;
+    ModelKind kind;
+    std::ofstream out;
+    uint64_t payload_size = 0;
+    uint64_t checksum = fnv1a64(nullptr, 0);
+};
+
+// Map a model file and validate magic, version, kind, size and checksum.
+// Returns a pointer to the payload inside `file`.
+// Throws std::runtime_error describing the first check that failed.
+const unsigned char* openModelFile(MappedFile& file, const std::string& filename,
+                                   ModelKind kind, size_t& payload_size);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+#include <cstddef>
+
+// Peak resident set size of this process so far, in bytes (0 if the
+// platform does not report it)
+size_t peakRssBytes();
+
+#endif
@@ -0,0 +1,279 @@
+#include "profiler.h"
+#include "process_stats.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> Profiler::on{false};
+atomic<bool> Profiler::trace_on{false};
+
+// ============ Histogram buckets ============
+
+// Four buckets per power of two (values 0..3 get one each), so a bucket's
+// midpoint is within 12.5% of anything in it; 256 buckets cover uint64
+static const int BUCKETS = 256;
+
+static int bucketOf(uint64_t ns) {
+    if (ns < 4) return (int)ns;
+    int e = 63;
+    while (!(ns >> e)) e--;
+    return 4 * (e - 1) + (int)((ns >> (e - 2)) & 3);
+}
+
+static double bucketMidpoint(int b) {
+    if (b < 4) return b;
+    int e = b / 4 + 1, sub = b % 4;
+    double width = ldexp(1.0, e - 2);
+    return (4 + sub) * width + width / 2;
+}
+
+// ============ Registry ============
+
+namespace {
+
+struct StageStats {
+    const char* name = nullptr;
+    atomic<uint64_t> calls{0};
+    atomic<uint64_t> total_ns{0};
+    atomic<uint64_t> buckets[BUCKETS];
+    StageStats() { for (auto& b : buckets) b.store(0, memory_order_relaxed); }
+};
+
+struct CounterStats {
+    const char* name = nullptr;
+    atomic<uint64_t> value{0};
+};
+
+struct TraceEvent {
+    int stage;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+// One per thread that recorded while tracing; owned by the registry so
+// events outlive their thread
+struct TraceBuffer {
+    int tid = 0;
+    vector<TraceEvent> events;
+};
+
+// Bounds trace memory on very long runs (about 24 MB per thread)
+const size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+struct Registry {
+    mutex lock;
+    StageStats stages[Profiler::MAX_STAGES];
+    atomic<int> stage_count{0};
+    CounterStats counters[Profiler::MAX_COUNTERS];
+    atomic<int> counter_count{0};
+    vector<unique_ptr<TraceBuffer>> traces;
+    atomic<uint64_t> dropped_events{0};
+    uint64_t enabled_at_ns = 0;
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+const chrono::steady_clock::time_point process_start = chrono::steady_clock::now();
+
+thread_local TraceBuffer* thread_trace = nullptr;
+
+}  // namespace
+
+void Profiler::enable(bool tracing)
+{
+    registry().enabled_at_ns = now_ns();
+    trace_on = tracing;
+    on = true;
+}
+
+uint64_t Profiler::now_ns()
+{
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - process_start).count();
+}
+
+// Linear search under the lock: there are only a few dozen names and each
+// call site looks its name up once
+template <typename Stats, int N>
+static int lookup(Stats (&table)[N], atomic<int>& count, const char* name, const char* kind)
+{
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    int n = count.load();
+    for (int i = 0; i < n; i++)
+        if (strcmp(table[i].name, name) == 0) return i;
+    if (n == N) throw runtime_error(string("Too many profiler ") + kind + "s");
+    table[n].name = name;
+    count.store(n + 1);
+    return n;
+}
+
+int Profiler::stage(const char* name)
+{
+    return lookup(registry().stages, registry().stage_count, name, "stage");
+}
+
+int Profiler::counter(const char* name)
+{
+    return lookup(registry().counters, registry().counter_count, name, "counter");
+}
+
+void Profiler::add(int counter, uint64_t amount)
+{
+    registry().counters[counter].value.fetch_add(amount, memory_order_relaxed);
+}
+
+void Profiler::record(int stage, uint64_t start_ns, uint64_t duration_ns)
+{
+    Registry& r = registry();
+    StageStats& s = r.stages[stage];
+    s.calls.fetch_add(1, memory_order_relaxed);
+    s.total_ns.fetch_add(duration_ns, memory_order_relaxed);
+    s.buckets[bucketOf(duration_ns)].fetch_add(1, memory_order_relaxed);
+
+    if (!tracing()) return;
+    if (!thread_trace) {
+        lock_guard<mutex> guard(r.lock);
+        r.traces.push_back(unique_ptr<TraceBuffer>(new TraceBuffer));
+        thread_trace = r.traces.back().get();
+        thread_trace->tid = (int)r.traces.size();
+    }
+    if (thread_trace->events.size() < MAX_EVENTS_PER_THREAD) {
+        thread_trace->events.push_back({stage, start_ns, duration_ns});
+    } else {
+        r.dropped_events.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+// ============ Output ============
+
+static double percentile(const StageStats& s, uint64_t calls, double p)
+{
+    uint64_t rank = (uint64_t)(p * calls);
+    if (rank >= calls) rank = calls - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += s.buckets[b].load(memory_order_relaxed);
+        if (seen > rank) return bucketMidpoint(b);
+    }
+    return bucketMidpoint(BUCKETS - 1);
+}
+
+void Profiler::report(ostream& out)
+{
+    Registry& r = registry();
+    double wall = (now_ns() - r.enabled_at_ns) / 1e9;
+
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(3)
+        << "\n=== PROFILE (" << wall << " s wall) ===" << endl
+        << left << setw(18) << "stage" << right << setw(10) << "calls" << setw(12) << "total ms"
+        << setw(9) << "% wall" << setw(11) << "mean us" << setw(11) << "p50 us"
+        << setw(11) << "p95 us" << setw(11) << "p99 us" << endl;
+    for (int i = 0; i < r.stage_count.load(); i++) {
+        const StageStats& s = r.stages[i];
+        uint64_t calls = s.calls.load();
+        if (calls == 0) continue;
+        double total = s.total_ns.load() / 1e6;
+        out << left << setw(18) << s.name << right << setw(10) << calls
+            << setprecision(1) << setw(12) << total
+            << setw(9) << (wall > 0 ? 100.0 * total / 1e3 / wall : 0.0)
+            << setw(11) << total * 1e3 / calls
+            << setw(11) << percentile(s, calls, 0.50) / 1e3
+            << setw(11) << percentile(s, calls, 0.95) / 1e3
+            << setw(11) << percentile(s, calls, 0.99) / 1e3 << endl;
+    }
+    out << "(stages on several threads can add up to more than 100% of wall time)" << endl;
+
+    for (int i = 0; i < r.counter_count.load(); i++) {
+        const CounterStats& c = r.counters[i];
+        uint64_t value = c.value.load();
+        out << left << setw(18) << c.name << right << setw(10) << value;
+        if (strcmp(c.name, "bytes_read") == 0) {
+            out << "  (" << setprecision(1) << value / (1024.0 * 1024.0) << " MB, "
+                << (wall > 0 ? value / (1024.0 * 1024.0) / wall : 0.0) << " MB/s)";
+        } else if (strcmp(c.name, "images") == 0) {
+            out << "  (" << setprecision(1) << (wall > 0 ? value / wall : 0.0) << " images/s)";
+        }
+        out << endl;
+    }
+    out << "peak RSS " << setprecision(1) << peakRssBytes() / (1024.0 * 1024.0) << " MB" << endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+static void writeJsonString(ostream& out, const char* s)
+{
+    out << '"';
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') out << '\\' << (char)c;
+        else if (c < 0x20) out << "\\u00" << "0123456789abcdef"[c >> 4] << "0123456789abcdef"[c & 15];
+        else out << (char)c;
+    }
+    out << '"';
+}
+
+void Profiler::write_trace(const string& filename)
+{
+    ofstream out(filename);
+    if (!out) throw runtime_error("Error: could not open " + filename + " for writing");
+
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& buffer : r.traces) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << buffer->tid << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+        first = false;
+        for (const TraceEvent& e : buffer->events) {
+            // Complete events, timestamps in microseconds
+            out << ",\n{\"name\":";
+            writeJsonString(out, r.stages[e.stage].name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << e.start_ns / 1000 << '.' << setw(3) << setfill('0') << e.start_ns % 1000
+                << ",\"dur\":" << e.duration_ns / 1000 << '.' << setw(3) << e.duration_ns % 1000
+                << setfill(' ') << '}';
+        }
+    }
+    out << "\n]}\n";
+    if (!out) throw runtime_error("Error: failed writing " + filename);
+    if (r.dropped_events.load()) {
+        cerr << "Trace: dropped " << r.dropped_events.load() << " events over the per-thread limit" << endl;
+    }
+}
+
+// ============ Session ============
+
+ProfileSession::ProfileSession(bool profile, const string& trace_path)
+    : active(profile || !trace_path.empty()), trace_path(trace_path)
+{
+    if (active) Profiler::enable(!trace_path.empty());
+}
+
+ProfileSession::~ProfileSession()
+{
+    if (!active) return;
+    Profiler::report(cerr);
+    if (trace_path.empty()) return;
+    try {
+        Profiler::write_trace(trace_path);
+        cerr << "Trace written to " << trace_path << " (open in chrome://tracing or ui.perfetto.dev)" << endl;
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Stage timers and counters for the hot paths. Profiling is off unless a
+// binary is run with --profile or --trace. While it is off, a
+// PROFILE_SCOPE costs one relaxed atomic load and reads no clock. While
+// it is on, each scope adds its duration to its stage's total and to a
+// log-bucketed latency histogram. With tracing, each scope is also kept
+// as a Chrome trace event.
+// Building with -DTB_NO_PROFILING compiles the macros away.
+//
+// Recording is lock-free (atomic adds) except for the first use of a call
+// site and, when tracing, the first event on a thread.
+class Profiler {
+public:
+    static const int MAX_STAGES = 64;
+    static const int MAX_COUNTERS = 16;
+
+    // Starts the wall clock the report measures against
+    static void enable(bool tracing = false);
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+    static bool tracing() { return trace_on.load(std::memory_order_relaxed); }
+
+    // Id for a named stage or counter; the same name always gets the same
+    // id. Meant to run once per call site (the macros cache the id).
+    static int stage(const char* name);
+    static int counter(const char* name);
+
+    static void add(int counter, uint64_t amount);
+    static void record(int stage, uint64_t start_ns, uint64_t duration_ns);
+
+    // Monotonic nanoseconds since the process started
+    static uint64_t now_ns();
+
+    // Per-stage calls, totals and p50/p95/p99 latency, the counters (with
+    // rates for bytes_read and images), and peak RSS
+    static void report(std::ostream& out);
+
+    // Chrome trace-event JSON (chrome://tracing, Perfetto) of every scope
+    // recorded while tracing. Throws std::runtime_error on failure.
+    static void write_trace(const std::string& filename);
+
+private:
+    static std::atomic<bool> on;
+    static std::atomic<bool> trace_on;
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(int stage)
+        : stage(stage), active(Profiler::enabled()), start(active ? Profiler::now_ns() : 0) {}
+    ~ScopedTimer() {
+        if (active) Profiler::record(stage, start, Profiler::now_ns() - start);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    int stage;
+    bool active;
+    uint64_t start;
+};
+
+// For main(): turns profiling on if asked and, on scope exit, prints the
+// report to stderr and writes the trace file
+class ProfileSession {
+public:
+    ProfileSession(bool profile, const std::string& trace_path);
+    ~ProfileSession();
+
+private:
+    bool active;
+    std::string trace_path;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifndef TB_NO_PROFILING
+// Times the rest of the enclosing block as stage `name` (a string literal)
+#define PROFILE_SCOPE(name)                                                       \
+    static const int PROFILE_CONCAT(profile_stage_, __LINE__) = Profiler::stage(name); \
+    ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)(PROFILE_CONCAT(profile_stage_, __LINE__))
+// Adds amount to counter `name`; amount is only evaluated when profiling
+#define PROFILE_COUNT(name, amount)                                  \
+    do {                                                             \
+        if (Profiler::enabled()) {                                   \
+            static const int profile_counter_ = Profiler::counter(name); \
+            Profiler::add(profile_counter_, (uint64_t)(amount));     \
+        }                                                            \
+    } while (0)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNT(name, amount) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,357 @@
+#include "random_forest.h"
+#include "task_pool.h"
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+RandomForest::RandomForest(int trees, int depth, int min_s)
+    : tree_count(trees), max_depth(depth), min_samples(min_s) {}
+
+// ============ Training ============
+
+void RandomForest::train(const vector<vector<double>>& X, const vector<int>& y, int threads)
+{
+    size_t n = X.size(), f = X.empty() ? 0 : X[0].size();
+    vector<double> columns(n * f);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < f; j++)
+            columns[j * n + i] = X[i][j];
+    train_columns(columns, y, n, f, threads);
+}
+
+void RandomForest::train(const FeatureMatrix& X, const vector<int>& y, int threads)
+{
+    size_t n = X.rows, f = X.cols;
+    vector<double> columns(n * f);
+    for (size_t i = 0; i < n; i++) {
+        const feature_t* row = X.row(i);
+        for (size_t j = 0; j < f; j++)
+            columns[j * n + i] = row[j];
+    }
+    train_columns(columns, y, n, f, threads);
+}
+
+// Walk sample i of a column-major matrix through one compiled tree
+static int predictColumn(const FlatNode* nodes, const double* columns,
+                         size_t n_samples, size_t i)
+{
+    uint32_t k = 0;
+    while (nodes[k].feature >= 0)
+        k = nodes[k].child + !(columns[nodes[k].feature * n_samples + i] < nodes[k].threshold);
+    return (int)nodes[k].child;
+}
+
+// All trees share one column-major copy of the data; each gets its own
+// bootstrap sample, trains single-threaded, and then votes on the samples
+// it did not see
+void RandomForest::train_columns(const vector<double>& columns, const vector<int>& y,
+                                 size_t n_samples, size_t n_features, int threads)
+{
+    nodes.clear();
+    root_offsets.clear();
+    mapped.close();
+    packed = nullptr;
+    roots = nullptr;
+    packed_size = n_trees = 0;
+    depth = 0;
+    oob = -1.0;
+    if (n_samples == 0 || n_features == 0 || tree_count <= 0) return;
+    if (y.size() != n_samples) {
+        throw runtime_error("Error: " + to_string(y.size()) + " labels for " +
+                            to_string(n_samples) + " samples");
+    }
+
+    int mtry = max_features > 0 ? max_features : max(1, (int)sqrt((double)n_features));
+
+    vector<DecisionTree> trees;
+    for (int t = 0; t < tree_count; t++) {
+        trees.emplace_back(max_depth, min_samples);
+        trees.back().max_features = mtry;
+        trees.back().seed = seed * 0x9e3779b97f4a7c15ULL + t;
+    }
+
+    // Integer vote counts, so the order trees finish in does not matter
+    vector<atomic<uint32_t>> oob_votes(n_samples), oob_ones(n_samples);
+
+    TaskPool pool(threads);
+    TaskPool::Group group;
+    for (int t = 0; t < tree_count; t++) {
+        pool.run(group, [&, t] {
+            DecisionTree& tree = trees[t];
+            mt19937_64 rng(tree.seed);
+            vector<size_t> samples(n_samples);
+            vector<char> in_bag(n_samples, 0);
+            for (size_t k = 0; k < n_samples; k++) {
+                samples[k] = rng() % n_samples;
+                in_bag[samples[k]] = 1;
+            }
+            sort(samples.begin(), samples.end());
+
+            tree.train_columns(columns.data(), y.data(), n_samples, n_features,
+                               std::move(samples), 1);
+            tree.compile();
+
+            const FlatNode* tree_nodes = tree.compiled_nodes();
+            for (size_t i = 0; i < n_samples; i++) {
+                if (in_bag[i]) continue;
+                oob_votes[i]++;
+                oob_ones[i] += predictColumn(tree_nodes, columns.data(), n_samples, i);
+            }
+        });
+    }
+    pool.wait(group);
+
+    size_t counted = 0, wrong = 0;
+    for (size_t i = 0; i < n_samples; i++) {
+        if (oob_votes[i] == 0) continue;
+        int vote = 2 * oob_ones[i] > oob_votes[i] ? 1 : 0;
+        counted++;
+        wrong += (vote != y[i]);
+    }
+    if (counted > 0) oob = (double)wrong / counted;
+
+    // Pack the compiled trees back to back, in tree order
+    for (DecisionTree& tree : trees) {
+        uint32_t base = (uint32_t)nodes.size();
+        root_offsets.push_back(base);
+        const FlatNode* tree_nodes = tree.compiled_nodes();
+        for (size_t k = 0; k < tree.compiled_size(); k++) {
+            FlatNode node = tree_nodes[k];
+            if (node.feature >= 0) node.child += base;
+            nodes.push_back(node);
+        }
+        depth = max(depth, tree.compiled_depth());
+    }
+
+    packed = nodes.data();
+    packed_size = nodes.size();
+    roots = root_offsets.data();
+    n_trees = root_offsets.size();
+}
+
+// ============ Prediction ============
+
+// Rows per block: every tree is walked over a block before moving on, so a
+// block's rows stay in cache for the whole forest
+static const size_t FOREST_BLOCK_ROWS = 64;
+
+// Rows walked through a tree together; see predictFlatRange in
+// decision_tree.cpp
+static const int FOREST_LANES = 8;
+
+// Smallest slice worth handing to its own thread (a row is walked once per
+// tree, so far fewer rows than for one tree)
+static const size_t FOREST_MIN_ROWS_PER_THREAD = 128;
+
+// Class-1 votes for rows [begin, end)
+void RandomForest::vote_range(const double* X, size_t cols, size_t begin, size_t end,
+                              uint32_t* votes) const
+{
+    for (size_t block = begin; block < end; block += FOREST_BLOCK_ROWS) {
+        size_t block_end = min(end, block + FOREST_BLOCK_ROWS);
+        for (size_t r = block; r < block_end; r++) votes[r] = 0;
+
+        for (size_t t = 0; t < n_trees; t++) {
+            uint32_t root = roots[t];
+            size_t r = block;
+            for (; r + FOREST_LANES <= block_end; r += FOREST_LANES) {
+                const double* rows[FOREST_LANES];
+                uint32_t idx[FOREST_LANES];
+                for (int s = 0; s < FOREST_LANES; s++) {
+                    rows[s] = X + (r + s) * cols;
+                    idx[s] = root;
+                }
+
+                bool active = true;
+                for (int step = 0; step < depth && active; step++) {
+                    active = false;
+                    for (int s = 0; s < FOREST_LANES; s++) {
+                        const FlatNode& node = packed[idx[s]];
+                        if (node.feature < 0) continue;
+                        idx[s] = node.child + !(rows[s][node.feature] < node.threshold);
+                        active = true;
+                    }
+                }
+
+                for (int s = 0; s < FOREST_LANES; s++)
+                    votes[r + s] += packed[idx[s]].child;
+            }
+
+            for (; r < block_end; r++) {
+                const double* x = X + r * cols;
+                uint32_t i = root;
+                while (packed[i].feature >= 0)
+                    i = packed[i].child + !(x[packed[i].feature] < packed[i].threshold);
+                votes[r] += packed[i].child;
+            }
+        }
+    }
+}
+
+void RandomForest::votes(const double* X, size_t rows, size_t cols, int threads,
+                         vector<uint32_t>& out) const
+{
+    out.resize(rows);
+    if (rows == 0 || n_trees == 0) return;
+
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    size_t max_threads = max<size_t>(1, rows / FOREST_MIN_ROWS_PER_THREAD);
+    if ((size_t)threads > max_threads) threads = (int)max_threads;
+
+    if (threads == 1) {
+        vote_range(X, cols, 0, rows, out.data());
+        return;
+    }
+
+    // Contiguous slices, one per thread; each writes only its own part of out
+    vector<thread> workers;
+    size_t chunk = (rows + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = t * chunk;
+        size_t end = min(rows, begin + chunk);
+        if (begin >= end) break;
+        workers.emplace_back([this, X, cols, begin, end, &out] {
+            vote_range(X, cols, begin, end, out.data());
+        });
+    }
+    for (auto& w : workers) w.join();
+}
+
+int RandomForest::predict(const vector<double>& x) const
+{
+    int out = 0;
+    predict_batch(x.data(), 1, x.size(), &out);
+    return out;
+}
+
+void RandomForest::predict_batch(const double* X, size_t rows, size_t cols,
+                                 int* out, int threads) const
+{
+    vector<uint32_t> count;
+    votes(X, rows, cols, threads, count);
+    for (size_t r = 0; r < rows; r++)
+        out[r] = 2 * count[r] > n_trees ? 1 : 0;
+}
+
+void RandomForest::vote_batch(const double* X, size_t rows, size_t cols,
+                              float* fraction, int threads) const
+{
+    vector<uint32_t> count;
+    votes(X, rows, cols, threads, count);
+    for (size_t r = 0; r < rows; r++)
+        fraction[r] = n_trees ? (float)count[r] / n_trees : 0.0f;
+}
+
+size_t RandomForest::feature_span() const
+{
+    size_t span = 0;
+    for (size_t i = 0; i < packed_size; i++) {
+        if (packed[i].feature >= 0) span = max(span, (size_t)packed[i].feature + 1);
+    }
+    return span;
+}
+
+// ============ Binary model file ============
+
+// Payload of a MODEL_RANDOM_FOREST file: this header, tree_count root
+// offsets, then node_count FlatNodes (each tree breadth-first, as
+// compile() lays it out, with internal children offset to packed indices).
+struct ForestPayload {
+    uint32_t tree_count;
+    uint32_t node_count;
+    int32_t depth;
+    uint32_t reserved;    // 0
+};
+
+bool RandomForest::save(const string& filename) const
+{
+    if (n_trees == 0) {
+        cerr << "Error: cannot save an untrained forest: " << filename << "\n";
+        return false;
+    }
+
+    ForestPayload head = {(uint32_t)n_trees, (uint32_t)packed_size, depth, 0};
+    size_t roots_bytes = n_trees * sizeof(uint32_t);
+    vector<unsigned char> payload(sizeof(head) + roots_bytes + packed_size * sizeof(FlatNode));
+    memcpy(payload.data(), &head, sizeof(head));
+    memcpy(payload.data() + sizeof(head), roots, roots_bytes);
+    memcpy(payload.data() + sizeof(head) + roots_bytes, packed, packed_size * sizeof(FlatNode));
+
+    try {
+        writeModelFile(filename, MODEL_RANDOM_FOREST, payload.data(), payload.size());
+    } catch (const std::exception& e) {
+        cerr << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool RandomForest::load(const string& filename)
+{
+    nodes.clear();
+    root_offsets.clear();
+    packed = nullptr;
+    roots = nullptr;
+    packed_size = n_trees = 0;
+    depth = 0;
+    oob = -1.0;
+
+    try {
+        size_t size;
+        const unsigned char* payload = openModelFile(mapped, filename,
+                                                     MODEL_RANDOM_FOREST, size);
+
+        ForestPayload head;
+        if (size < sizeof(head)) {
+            throw runtime_error("Error: forest payload is truncated: " + filename);
+        }
+        memcpy(&head, payload, sizeof(head));
+        if (head.tree_count == 0 || head.node_count == 0 ||
+            size != sizeof(head) + (size_t)head.tree_count * sizeof(uint32_t) +
+                    (size_t)head.node_count * sizeof(FlatNode)) {
+            throw runtime_error("Error: forest counts do not match file size: " + filename);
+        }
+
+        const uint32_t* tree_roots = (const uint32_t*)(payload + sizeof(head));
+        const FlatNode* tree_nodes = (const FlatNode*)(payload + sizeof(head) +
+                                                       head.tree_count * sizeof(uint32_t));
+
+        // Trees are contiguous and in order, and inside each one children
+        // follow their parent, so every walk ends at a leaf of its own tree.
+        // The lane walk takes `depth` steps, so the header must name the
+        // deepest tree's depth.
+        int deepest = 0;
+        for (uint32_t t = 0; t < head.tree_count; t++) {
+            uint32_t begin = tree_roots[t];
+            uint32_t end = t + 1 < head.tree_count ? tree_roots[t + 1] : head.node_count;
+            if ((t == 0 && begin != 0) || begin >= end || end > head.node_count) {
+                throw runtime_error("Error: forest tree offsets are corrupt: " + filename);
+            }
+            deepest = max(deepest, flatTreeDepth(tree_nodes, begin, end, filename));
+        }
+        if (head.depth != deepest) {
+            throw runtime_error("Error: forest depth does not match its trees: " + filename);
+        }
+
+        packed = tree_nodes;
+        packed_size = head.node_count;
+        roots = tree_roots;
+        n_trees = head.tree_count;
+        depth = deepest;
+    } catch (const std::exception& e) {
+        cerr << e.what() << "\n";
+        mapped.close();
+        packed = nullptr;
+        roots = nullptr;
+        packed_size = n_trees = 0;
+        return false;
+    }
+    return true;
+}
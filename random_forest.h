@@ -0,0 +1,92 @@
+#ifndef RANDOM_FOREST_H
+#define RANDOM_FOREST_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "decision_tree.h"
+#include "feature_matrix.h"
+#include "model_file.h"
+
+// Bagged ensemble of DecisionTrees. Each tree trains on its own bootstrap
+// sample of the rows and searches a random subset of the features at every
+// node; the forest predicts by majority vote (a tie goes to class 0, as in
+// a leaf).
+//
+// After training, the trees are packed into one contiguous FlatNode array
+// (internal nodes' children offset to their packed position, leaves
+// unchanged), and batch prediction walks a block of rows through every tree
+// in turn, several rows at a time, so the rows stay in cache while the
+// trees stream past.
+class RandomForest {
+public:
+    int tree_count;
+    int max_depth;
+    int min_samples;
+    int max_features = 0;     // per split; 0 uses sqrt(feature count)
+    uint64_t seed = 1;
+
+    RandomForest(int trees = 100, int depth = 12, int min_s = 2);
+
+    RandomForest(const RandomForest&) = delete;
+    RandomForest& operator=(const RandomForest&) = delete;
+    RandomForest(RandomForest&&) = default;
+    RandomForest& operator=(RandomForest&&) = default;
+
+    // Trees train in parallel on a TaskPool (threads <= 0: one per core).
+    // Every tree's bootstrap sample and feature subsets come from `seed`,
+    // so the same data gives the same forest at any thread count.
+    void train(const std::vector<std::vector<double>>& X,
+               const std::vector<int>& y, int threads = 0);
+    void train(const FeatureMatrix& X, const std::vector<int>& y, int threads = 0);
+
+    // Out-of-bag error of the last train(): the fraction of samples that
+    // the trees which never saw them vote wrong (samples in every bootstrap
+    // are left out). -1 if unknown, e.g. after load().
+    double oob_error() const { return oob; }
+
+    int predict(const std::vector<double>& x) const;
+
+    // Labels (or the fraction of trees voting class 1) for every row of a
+    // row-major rows x cols matrix. threads > 1 (or <= 0 for one per core)
+    // splits large batches across threads.
+    void predict_batch(const double* X, size_t rows, size_t cols,
+                       int* out, int threads = 1) const;
+    void vote_batch(const double* X, size_t rows, size_t cols,
+                    float* fraction, int threads = 1) const;
+
+    // MODEL_RANDOM_FOREST model file (see model_file.h): the packed node
+    // array behind a checksummed header. load() maps the file and predicts
+    // from it in place. Both print and return false on failure.
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+    size_t size() const { return n_trees; }
+    size_t node_count() const { return packed_size; }
+
+    // Smallest row width the forest can be applied to
+    size_t feature_span() const;
+
+private:
+    // Packed trees: tree t starts at packed[roots[t]]. Both point into the
+    // vectors after train(), or into `mapped` after load().
+    std::vector<FlatNode> nodes;
+    std::vector<uint32_t> root_offsets;
+    MappedFile mapped;
+    const FlatNode* packed = nullptr;
+    const uint32_t* roots = nullptr;
+    size_t packed_size = 0;
+    size_t n_trees = 0;
+    int depth = 0;            // deepest tree
+    double oob = -1.0;
+
+    void train_columns(const std::vector<double>& columns, const std::vector<int>& y,
+                       size_t n_samples, size_t n_features, int threads);
+    void vote_range(const double* X, size_t cols, size_t begin, size_t end,
+                    uint32_t* votes) const;
+    void votes(const double* X, size_t rows, size_t cols, int threads,
+               std::vector<uint32_t>& out) const;
+};
+
+#endif
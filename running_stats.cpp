@@ -0,0 +1,59 @@
+#include "running_stats.h"
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+RunningStats::RunningStats(size_t features)
+    : means(features, 0.0), m2(features, 0.0) {}
+
+void RunningStats::add(const feature_t* x) {
+    n++;
+    double inv = 1.0 / n;
+    size_t f = means.size();
+    for (size_t j = 0; j < f; j++) {
+        double d = x[j] - means[j];
+        means[j] += d * inv;
+        m2[j] += d * (x[j] - means[j]);
+    }
+}
+
+void RunningStats::merge(const RunningStats& other) {
+    if (other.size() != size()) {
+        throw runtime_error("Error: cannot merge statistics over " + to_string(other.size()) +
+                            " features into " + to_string(size()));
+    }
+    if (other.n == 0) return;
+    if (n == 0) {
+        *this = other;
+        return;
+    }
+
+    double total = (double)n + other.n;
+    double w = other.n / total;
+    double cross = (double)n * other.n / total;
+    for (size_t j = 0; j < means.size(); j++) {
+        double d = other.means[j] - means[j];
+        means[j] += d * w;
+        m2[j] += other.m2[j] + d * d * cross;
+    }
+    n += other.n;
+}
+
+vector<double> RunningStats::stdev() const {
+    vector<double> re(m2.size(), 0.0);
+    if (n == 0) return re;
+    for (size_t j = 0; j < m2.size(); j++) re[j] = sqrt(m2[j] / n);
+    return re;
+}
+
+vector<double> normalizedCentroid(const RunningStats& cls, const vector<double>& means,
+                                  const vector<double>& stdevs) {
+    vector<double> re(means.size(), 0.0);
+    for (size_t j = 0; j < means.size(); j++) {
+        if (stdevs[j] > 1e-10) {
+            re[j] = (cls.mean()[j] - means[j]) / stdevs[j];
+        }
+    }
+    return re;
+}
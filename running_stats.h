@@ -0,0 +1,39 @@
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <vector>
+#include <cstddef>
+#include "feature_matrix.h"
+
+// Per-feature count, mean and sum of squared deviations, updated one row
+// at a time (Welford), so a dataset's statistics never need the dataset in
+// memory. Two accumulators over disjoint rows merge as if one had seen
+// both (Chan et al.). Results depend only on the order of add() and
+// merge() calls, so a fixed order gives bit-identical output.
+class RunningStats {
+public:
+    explicit RunningStats(size_t features = 0);
+
+    void add(const feature_t* x);
+    void merge(const RunningStats& other);
+
+    size_t count() const { return n; }
+    size_t size() const { return means.size(); }
+    const std::vector<double>& mean() const { return means; }
+
+    // Population standard deviation (divides by count)
+    std::vector<double> stdev() const;
+
+private:
+    size_t n = 0;
+    std::vector<double> means;
+    std::vector<double> m2;
+};
+
+// Class centroid in z-score space. The mean of (x - means) / stdevs over
+// a class is (class mean - means) / stdevs, so no row is revisited;
+// features with no spread normalize to 0.
+std::vector<double> normalizedCentroid(const RunningStats& cls, const std::vector<double>& means,
+                                       const std::vector<double>& stdevs);
+
+#endif
@@ -0,0 +1,129 @@
+#include "task_pool.h"
+#include <algorithm>
+
+using namespace std;
+
+// Which pool (if any) the current thread works for, and its index there
+static thread_local const TaskPool* current_pool = nullptr;
+static thread_local int current_index = 0;
+
+TaskPool::TaskPool(int threads)
+{
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    participants = threads;
+
+    for (int i = 0; i < threads; i++) queues.push_back(make_unique<Queue>());
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        lock_guard<mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+int TaskPool::thread_index() const
+{
+    return current_pool == this ? current_index : 0;
+}
+
+void TaskPool::run(Group& group, function<void()> task)
+{
+    group.pending++;
+    {
+        // Count first so queued never drops below the tasks in the queues;
+        // taking the lock orders this against a worker about to sleep
+        lock_guard<mutex> lock(sleep_mutex);
+        queued++;
+    }
+    Queue& q = *queues[thread_index()];
+    {
+        lock_guard<mutex> lock(q.m);
+        q.tasks.push_back({std::move(task), &group});
+    }
+    sleep_cv.notify_one();
+}
+
+// Newest task from our own queue, else the oldest from someone else's
+bool TaskPool::try_pop(int self, Task& task)
+{
+    if (queued == 0) return false;
+
+    {
+        Queue& q = *queues[self];
+        lock_guard<mutex> lock(q.m);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (int k = 1; k < participants; k++) {
+        Queue& q = *queues[(self + k) % participants];
+        lock_guard<mutex> lock(q.m);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::execute(Task& task)
+{
+    try {
+        task.fn();
+    } catch (...) {
+        lock_guard<mutex> lock(task.group->error_mutex);
+        if (!task.group->error) task.group->error = current_exception();
+    }
+    task.fn = nullptr;
+    task.group->pending--;
+}
+
+void TaskPool::worker_loop(int self)
+{
+    current_pool = this;
+    current_index = self;
+
+    Task task;
+    for (;;) {
+        if (try_pop(self, task)) {
+            execute(task);
+            continue;
+        }
+        unique_lock<mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [&] { return stopping || queued > 0; });
+        if (stopping) return;
+    }
+}
+
+void TaskPool::wait(Group& group)
+{
+    int self = thread_index();
+    Task task;
+    while (group.pending > 0) {
+        if (try_pop(self, task)) {
+            execute(task);
+        } else {
+            // The remaining tasks are running elsewhere
+            this_thread::yield();
+        }
+    }
+
+    lock_guard<mutex> lock(group.error_mutex);
+    if (group.error) {
+        exception_ptr e = group.error;
+        group.error = nullptr;
+        rethrow_exception(e);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+// Work-stealing pool for fork-join work such as recursive tree building.
+// Each worker has its own deque: it pushes and pops its newest tasks at the
+// back (depth first, cache warm) while idle workers steal the oldest, and
+// usually largest, tasks from the front. A thread waiting on a group runs
+// queued tasks instead of blocking, so tasks may fork and wait on their
+// own subtasks without tying up workers.
+class TaskPool {
+public:
+    // Tasks forked together; wait() returns when all of them have finished
+    class Group {
+    public:
+        Group() = default;
+        Group(const Group&) = delete;
+        Group& operator=(const Group&) = delete;
+
+    private:
+        friend class TaskPool;
+        std::atomic<size_t> pending{0};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    // threads participants: threads - 1 background workers plus whichever
+    // thread calls wait(). threads <= 0 uses one per core.
+    explicit TaskPool(int threads = 0);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    int size() const { return participants; }
+
+    // Index of the calling thread: 1..size()-1 for workers, 0 for any
+    // other thread. Lets tasks use per-thread scratch buffers, provided
+    // only one outside thread waits on the pool at a time.
+    int thread_index() const;
+
+    void run(Group& group, std::function<void()> task);
+
+    // Run tasks until every task in group has finished, then rethrow the
+    // first exception any of them threw
+    void wait(Group& group);
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        Group* group;
+    };
+    struct Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    bool try_pop(int self, Task& task);
+    void execute(Task& task);
+    void worker_loop(int self);
+
+    int participants;
+    std::vector<std::unique_ptr<Queue>> queues;    // [0] is shared by outside threads
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> queued{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+};
+
+#endif
@@ -2,41 +2,37 @@
 #include <iomanip>
 #include <fstream>
 #include "image_processor.h"
+#include "ingest.h"
 #include "decision_tree.h"
+#include "centroid_model.h"
+#include "running_stats.h"
+#include "random_forest.h"
+#include "process_stats.h"
+#include "profiler.h"
+#include "cross_validation.h"
 #include <filesystem>
+#include <limits>
+#include <chrono>
 namespace fs = std::filesystem;
 
 using namespace std;
-void addData(string directory_path, int label, vector<vector<double>> &X, vector<int> &y){
-    if (!fs::exists(directory_path) || !fs::is_directory(directory_path)) {
-        std::cerr << "Error: Directory '" << directory_path << "' does not exist or is not a directory." << std::endl;
-        return ;
-    }
-        
-    int cnt = 0;
-    for (const auto& entry : fs::directory_iterator(directory_path)) {
-        cnt++;
-        if(cnt % 200 == 0) cout << "Processed " << cnt << " files..." << endl;
-        if (fs::is_regular_file(entry.status())) {
-            string fname = entry.path().string();
-            vector<vector<double>> img = imageToVector(fname);
-            vector<double> imgf = flatten(img);
-            X.push_back(imgf);
-            y.push_back(label);
-        }
-    }
-}
-vector<double> average(vector<vector<double>> &X){
-    vector<double> re(X[0].size());
-    for(int i = 0 ; i < X.size(); i++){
-        for(int j = 0;  j < X[0].size(); j++){
-            re[j] += X[i][j];
-        }
-    }
-    for(int j = 0;  j < X[0].size(); j++){
-        re[j] /= X.size();
-    }
-    return re;
+// Stream every image in a directory into stats. Rows are only kept (in X,
+// labelled in y) when a model that needs them is being trained.
+void addData(string directory_path, int label, const PreprocessParams& params,
+             RunningStats &stats, FeatureCache* cache,
+             FeatureMatrix* X, vector<int>* y){
+    streamDirectory(directory_path, params,
+                    [&](const StreamedRow& r){
+                        PROFILE_SCOPE("stats_update");
+                        stats.add(r.features);
+                        if (X) {
+                            size_t row = X->rows;
+                            X->resize(row + 1, stats.size());
+                            copy(r.features, r.features + X->cols, X->row(row));
+                            y->push_back(label);
+                        }
+                    },
+                    0, cache);
 }
 double dot(vector<double>& a, vector<double> &b){
     assert(a.size() == b.size());
@@ -48,72 +44,100 @@ double dot(vector<double>& a, vector<double> &b){
     return re;
 }
 
-// Normalize features using z-score (mean=0, std=1)
-void normalizeFeatures(vector<vector<double>>& X, vector<double>& means, vector<double>& stdevs) {
-    if (X.empty()) return;
-    
-    // Calculate means
-    means.resize(X[0].size(), 0);
-    for (const auto& sample : X) {
-        for (size_t j = 0; j < sample.size(); j++) {
-            means[j] += sample[j];
-        }
-    }
-    for (size_t j = 0; j < means.size(); j++) {
-        means[j] /= X.size();
-    }
-    
-    // Calculate standard deviations
-    stdevs.resize(X[0].size(), 0);
-    for (const auto& sample : X) {
-        for (size_t j = 0; j < sample.size(); j++) {
-            double diff = sample[j] - means[j];
-            stdevs[j] += diff * diff;
-        }
-    }
-    for (size_t j = 0; j < stdevs.size(); j++) {
-        stdevs[j] = sqrt(stdevs[j] / X.size());
-    }
-    
-    // Normalize all samples
-    for (auto& sample : X) {
-        for (size_t j = 0; j < sample.size(); j++) {
-            if (stdevs[j] > 1e-10) {
-                sample[j] = (sample[j] - means[j]) / stdevs[j];
-            } else {
-                sample[j] = 0.0;
-            }
-        }
-    }
-}
 using namespace std;
-int main() {
+int main(int argc, char** argv) {
     try {
-        vector<vector<double>> X;
+        // --no-cache: decode every image even if its features are cached
+        // --forest N: also train an N-tree random forest into forest.bin
+        //   (this keeps every feature row in memory)
+        // --reduced-decode N: decode JPEGs at reduced resolution, keeping at
+        //   least N * image_size pixels (stored in the model, so inference
+        //   decodes the same way; image_processor --decode-report compares)
+        // --cv K: instead of training, decode the dataset once and report
+        //   stratified K-fold cross-validation of the centroid model and a
+        //   decision tree (all folds fit in parallel); writes no files
+        //   besides the feature cache
+        // --profile: print per-stage timings, counters and peak RSS to
+        //   stderr at exit; --trace FILE also writes a Chrome trace
+        bool use_cache = true, profile = false;
+        int cv_folds = 0;
+        string trace_path;
+        int forest_trees = 0;
+        PreprocessParams preprocess;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--no-cache") use_cache = false;
+            else if (arg == "--forest" && i + 1 < argc) forest_trees = stoi(argv[++i]);
+            else if (arg == "--reduced-decode" && i + 1 < argc) preprocess.reduced_decode = stoul(argv[++i]);
+            else if (arg == "--cv" && i + 1 < argc) cv_folds = stoi(argv[++i]);
+            else if (arg == "--profile") profile = true;
+            else if (arg == "--trace" && i + 1 < argc) trace_path = argv[++i];
+            else throw runtime_error("Unknown option: " + arg +
+                                     "\nUsage: trainer [--no-cache] [--forest N] [--reduced-decode N]"
+                                     " [--cv K] [--profile] [--trace FILE]");
+        }
+        ProfileSession profile_session(profile, trace_path);
+
+        size_t cols = (size_t)preprocess.image_size * preprocess.image_size;
+        FeatureCache cache("feature_cache", preprocess);
+        FeatureCache* cache_ptr = use_cache ? &cache : nullptr;
+
+        // One pass over the images: running per-class statistics, merged
+        // (always Normal then TB) into the global normalization statistics
+        RunningStats normal(cols), positive(cols);
+        FeatureMatrix X;
         vector<int> y;
-        vector<double> means, stdevs;
-        
+        bool keep_rows = forest_trees > 0 || cv_folds > 0;
+        FeatureMatrix* keep_X = keep_rows ? &X : nullptr;
+        vector<int>* keep_y = keep_rows ? &y : nullptr;
+        auto decode_start = chrono::steady_clock::now();
+
         cout << "Loading Normal images..." << endl;
-        addData("./TB_Chest_Radiography_Database/Normal", 0, X, y);
-        int normal_count = X.size();
+        addData("./TB_Chest_Radiography_Database/Normal", 0, preprocess, normal, cache_ptr, keep_X, keep_y);
 
         cout << "Loading Tuberculosis images..." << endl;
-        addData("./TB_Chest_Radiography_Database/Tuberculosis", 1, X, y);
-        int tb_count = X.size() - normal_count;
-        
-        cout << "Loaded " << normal_count << " Normal images and " << tb_count << " TB images" << endl;
+        addData("./TB_Chest_Radiography_Database/Tuberculosis", 1, preprocess, positive, cache_ptr, keep_X, keep_y);
+        if (use_cache) cache.save();
+
+        cout << "Loaded " << normal.count() << " Normal images and " << positive.count() << " TB images" << endl;
+        if (normal.count() == 0 || positive.count() == 0) {
+            throw runtime_error("Error: need at least one Normal and one TB image to train");
+        }
+
+        if (cv_folds > 0) {
+            CrossValidationOptions options;
+            options.folds = cv_folds;
+            auto cv_start = chrono::steady_clock::now();
+            vector<FoldResult> results = crossValidate(X, y, options);
+            auto cv_end = chrono::steady_clock::now();
+            printCrossValidation(results, cout);
+            cout << "\nDecode " << fixed << setprecision(1)
+                 << chrono::duration<double>(cv_start - decode_start).count() << " s, "
+                 << cv_folds << " folds fit and evaluated in "
+                 << chrono::duration<double>(cv_end - cv_start).count() << " s" << endl;
+            cout << "Peak memory: " << peakRssBytes() / (1024.0 * 1024.0) << " MB" << endl;
+            return 0;
+        }
+
         cout << "Normalizing features (z-score)..." << endl;
-        normalizeFeatures(X, means, stdevs);
-        
-        // Separate data after normalization
-        vector<vector<double>> normal_X(X.begin(), X.begin() + normal_count);
-        vector<vector<double>> tb_X(X.begin() + normal_count, X.end());
-        
-        vector<double> normal_avg = average(normal_X);
-        vector<double> positive_avg = average(tb_X);
+        RunningStats all = normal;
+        all.merge(positive);
+        vector<double> means = all.mean();
+        vector<double> stdevs = all.stdev();
+
+        vector<double> normal_avg = normalizedCentroid(normal, means, stdevs);
+        vector<double> positive_avg = normalizedCentroid(positive, means, stdevs);
         
+        cout << "Saving model bundle..." << endl;
+        {
+            PROFILE_SCOPE("save_model");
+            CentroidModel::save("model.bin", normal_avg, positive_avg, means, stdevs, preprocess);
+        }
+
+        // Text copies for inspection; max_digits10 keeps them lossless
         cout << "Saving normalized weights..." << endl;
         std::ofstream os("weights.txt");
+        os << setprecision(numeric_limits<double>::max_digits10);
         for(size_t i = 0 ; i < positive_avg.size(); i++){
             os << normal_avg[i] << " \n"[i == positive_avg.size() - 1];
         }
@@ -126,6 +150,7 @@ int main() {
         // Save normalization parameters (means and stdevs for z-score)
         cout << "Saving normalization parameters..." << endl;
         std::ofstream norm_os("normalization.txt");
+        norm_os << setprecision(numeric_limits<double>::max_digits10);
         norm_os << means.size() << "\n";
         for (double val : means) {
             norm_os << val << " ";
@@ -137,7 +162,25 @@ int main() {
         norm_os << "\n";
         norm_os.close();
         
-        cout << "Training complete! Weights and normalization parameters saved." << endl;
+        if (forest_trees > 0) {
+            // Trees split on raw preprocessed features; z-scoring is
+            // monotonic per feature, so it would not change any split
+            cout << "Training random forest (" << forest_trees << " trees)..." << endl;
+            RandomForest forest(forest_trees);
+            auto start = chrono::steady_clock::now();
+            {
+                PROFILE_SCOPE("forest_train");
+                forest.train(X, y);
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "Forest trained in " << fixed << setprecision(1) << seconds << " s, "
+                 << forest.node_count() << " nodes, out-of-bag error "
+                 << setprecision(2) << forest.oob_error() * 100 << "%" << endl;
+            if (!forest.save("forest.bin")) return 1;
+        }
+
+        cout << "Training complete! Model bundle, weights and normalization parameters saved." << endl;
+        cout << "Peak memory: " << fixed << setprecision(1) << peakRssBytes() / (1024.0 * 1024.0) << " MB" << endl;
 
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "decision_tree.h"
+#ifdef TB_HAVE_COMPILED_TREE
+#include "compiled_tree.h"
+#endif
+
+using namespace std;
+
+// Checks that a tree compiled to C++ predicts exactly as the tree it was
+// generated from. CMake builds this file twice and ctest runs the check:
+//
+//   tree_check_model TREE   train a tree on fixed synthetic data, save it
+//   tree_check TREE         (TREE compiled in by tree_codegen) train the
+//                           same tree again and compare the pointer walk,
+//                           the flat walk, predict_batch, the loaded file
+//                           and the generated code on fresh rows
+//
+// Exits non-zero on any mismatch. Needs no OpenCV.
+
+static const size_t TRAIN_ROWS = 4000;
+static const size_t TEST_ROWS = 20000;
+static const size_t FEATURES = 64;
+
+// Two classes, the second shifted on every 7th feature (as in bench)
+static void makeData(size_t n, unsigned seed, vector<vector<double>>& X, vector<int>& y)
+{
+    mt19937 rng(seed);
+    normal_distribution<float> noise(0.0f, 1.0f);
+    X.assign(n, vector<double>(FEATURES));
+    y.assign(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        y[i] = rng() % 2;
+        for (size_t j = 0; j < FEATURES; j++) {
+            float v = noise(rng);
+            if (y[i] == 1 && j % 7 == 0) v += 0.5f;
+            X[i][j] = v;
+        }
+    }
+}
+
+static void trainTree(DecisionTree& tree)
+{
+    vector<vector<double>> X;
+    vector<int> y;
+    makeData(TRAIN_ROWS, 1, X, y);
+    tree.train(X, y);
+}
+
+int main(int argc, char** argv) {
+    try {
+        if (argc != 2) throw runtime_error("Usage: tree_check TREE");
+        string path = argv[1];
+        DecisionTree tree(10, 2);
+        trainTree(tree);
+
+#ifndef TB_HAVE_COMPILED_TREE
+        if (!tree.save(path)) return 1;
+        cout << "Wrote a depth-" << tree.max_depth << " tree to " << path << endl;
+#else
+        vector<vector<double>> X;
+        vector<int> y;
+        makeData(TEST_ROWS, 2, X, y);
+        vector<double> packed(TEST_ROWS * FEATURES);
+        for (size_t r = 0; r < TEST_ROWS; r++)
+            copy(X[r].begin(), X[r].end(), packed.begin() + r * FEATURES);
+
+        vector<int> pointer(TEST_ROWS);
+        for (size_t r = 0; r < TEST_ROWS; r++) pointer[r] = tree.predict(X[r]);
+        tree.compile();
+        if (tree.compiled_size() != compiled_tree_nodes || tree.compiled_depth() != compiled_tree_depth) {
+            cerr << "Error: the compiled tree has " << compiled_tree_nodes << " nodes (depth "
+                 << compiled_tree_depth << "), training gave " << tree.compiled_size()
+                 << " (depth " << tree.compiled_depth() << ")" << endl;
+            return 1;
+        }
+        if (compiled_tree_feature_span > FEATURES) {
+            cerr << "Error: the compiled tree reads feature " << compiled_tree_feature_span - 1
+                 << " of " << FEATURES << endl;
+            return 1;
+        }
+
+        DecisionTree loaded;
+        if (!loaded.load(path)) return 1;
+
+        vector<int> batch(TEST_ROWS), loaded_batch(TEST_ROWS), compiled_batch(TEST_ROWS);
+        tree.predict_batch(packed.data(), TEST_ROWS, FEATURES, batch.data());
+        loaded.predict_batch(packed.data(), TEST_ROWS, FEATURES, loaded_batch.data());
+        compiled_tree_predict_batch(packed.data(), TEST_ROWS, FEATURES, compiled_batch.data());
+
+        size_t mismatches = 0;
+        for (size_t r = 0; r < TEST_ROWS; r++) {
+            int expected = pointer[r];
+            mismatches += (tree.predict(X[r]) != expected) + (batch[r] != expected) +
+                          (loaded_batch[r] != expected) +
+                          (compiled_tree_predict(packed.data() + r * FEATURES) != expected) +
+                          (compiled_batch[r] != expected);
+        }
+
+        cout << compiled_tree_nodes << " nodes, depth " << compiled_tree_depth << ", "
+             << TEST_ROWS << " rows: " << mismatches << " mismatches" << endl;
+        if (mismatches) return 1;
+#endif
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include "decision_tree.h"
+
+using namespace std;
+
+// Compiles a saved DecisionTree to C++ defining the functions declared in
+// compiled_tree.h. CMake runs it when configured with -DTB_COMPILED_TREE.
+//
+//   tree_codegen TREE OUT.cpp
+//
+// TREE is a binary model file (DecisionTree::save), or a text export
+// (DecisionTree::export_text) if its name ends in .txt.
+
+static bool endsWith(const string& s, const string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    try {
+        if (argc != 3) throw runtime_error("Usage: tree_codegen TREE OUT.cpp");
+        string tree_path = argv[1], out_path = argv[2];
+
+        DecisionTree tree;
+        bool loaded = endsWith(tree_path, ".txt") ? tree.import_text(tree_path)
+                                                  : tree.load(tree_path);
+        if (!loaded) return 1;
+        if (!tree.export_cpp(out_path, tree_path)) return 1;
+
+        cout << "Compiled " << tree.compiled_size() << " nodes (depth "
+             << tree.compiled_depth() << ") from " << tree_path << " into " << out_path << endl;
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "unix_socket.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+int listenUnix(const string&, int) { throw runtime_error("Error: Unix domain sockets are not supported on this platform"); }
+int connectUnix(const string&) { throw runtime_error("Error: Unix domain sockets are not supported on this platform"); }
+int acceptUnix(int, int) { return -1; }
+void removeSocketFile(const string&) {}
+bool writeAll(int, const void*, size_t) { return false; }
+void shutdownSocket(int) {}
+void closeSocket(int) {}
+bool SocketReader::fill() { return false; }
+
+#else
+
+static sockaddr_un socketAddress(const string& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw runtime_error("Error: socket path too long: " + path);
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+int listenUnix(const string& path, int backlog)
+{
+    sockaddr_un addr = socketAddress(path);
+
+    // Only ever remove a socket, never a regular file someone pointed us at
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) throw runtime_error("Error: " + path + " exists and is not a socket");
+        unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw runtime_error("Error: socket() failed: " + string(strerror(errno)));
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+        string reason = strerror(errno);
+        ::close(fd);
+        throw runtime_error("Error: cannot listen on " + path + ": " + reason);
+    }
+    return fd;
+}
+
+int connectUnix(const string& path)
+{
+    sockaddr_un addr = socketAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw runtime_error("Error: socket() failed: " + string(strerror(errno)));
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        string reason = strerror(errno);
+        ::close(fd);
+        throw runtime_error("Error: cannot connect to " + path + ": " + reason);
+    }
+    return fd;
+}
+
+int acceptUnix(int listen_fd, int timeout_ms)
+{
+    pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) return -1;
+    return accept(listen_fd, nullptr, nullptr);
+}
+
+void removeSocketFile(const string& path)
+{
+    unlink(path.c_str());
+}
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+void shutdownSocket(int fd)
+{
+    ::shutdown(fd, SHUT_RDWR);
+}
+
+void closeSocket(int fd)
+{
+    ::close(fd);
+}
+
+bool SocketReader::fill()
+{
+    for (;;) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        begin = 0;
+        end = n;
+        return true;
+    }
+}
+
+#endif
+
+bool writeAll(int fd, const string& text)
+{
+    return writeAll(fd, text.data(), text.size());
+}
+
+bool SocketReader::readLine(string& line, size_t max_line)
+{
+    line.clear();
+    for (;;) {
+        if (begin == end && !fill()) return false;
+        const char* start = buf + begin;
+        const char* newline = (const char*)memchr(start, '\n', end - begin);
+        size_t take = newline ? newline - start : end - begin;
+        if (line.size() + take > max_line) return false;
+        line.append(start, take);
+        begin += take;
+        if (newline) {
+            begin++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+    }
+}
+
+bool SocketReader::readExact(void* out, size_t size)
+{
+    char* dst = (char*)out;
+    while (size > 0) {
+        if (begin == end && !fill()) return false;
+        size_t take = min(size, end - begin);
+        memcpy(dst, buf + begin, take);
+        begin += take;
+        dst += take;
+        size -= take;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef UNIX_SOCKET_H
+#define UNIX_SOCKET_H
+
+#include <string>
+#include <cstddef>
+
+// Minimal blocking Unix domain socket helpers shared by the inference
+// server and its load generator. listenUnix/connectUnix throw
+// runtime_error on failure (and on platforms without Unix sockets).
+
+// Bind and listen on `path`, replacing a stale socket file left by a
+// previous run
+int listenUnix(const std::string& path, int backlog = 64);
+int connectUnix(const std::string& path);
+
+// Next connection on a listening socket, or -1 if none arrived within
+// timeout_ms (so the caller can check for shutdown in between)
+int acceptUnix(int listen_fd, int timeout_ms);
+
+// Remove the socket file created by listenUnix
+void removeSocketFile(const std::string& path);
+
+// Write every byte; false if the peer went away
+bool writeAll(int fd, const void* data, size_t size);
+bool writeAll(int fd, const std::string& text);
+
+// Stop reads and writes on fd (wakes a thread blocked on it), and close
+void shutdownSocket(int fd);
+void closeSocket(int fd);
+
+// Buffered reader for the line + payload framing used by the server
+class SocketReader {
+public:
+    explicit SocketReader(int fd) : fd(fd) {}
+
+    // Next '\n'-terminated line without the terminator. False on EOF,
+    // error, or a line longer than max_line.
+    bool readLine(std::string& line, size_t max_line = 8192);
+
+    // Exactly size bytes; false on EOF or error
+    bool readExact(void* out, size_t size);
+
+private:
+    bool fill();
+
+    int fd;
+    char buf[4096];
+    size_t begin = 0, end = 0;
+};
+
+#endif